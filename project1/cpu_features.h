@@ -0,0 +1,128 @@
+#pragma once
+// CPU特性检测：用cpuid/xgetbv在运行时判断可用的指令集扩展，
+// 配合CPU_TARGET按函数启用指令集，同一个二进制可在不同CPU上选择最快的实现
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC不需要target属性即可使用全部intrinsics
+#define CPU_TARGET(x)
+#else
+#include <cpuid.h>
+#define CPU_TARGET(x) __attribute__((target(x)))
+#endif
+
+// CPU特性位掩码
+enum CpuFeature : uint32_t {
+    CPU_SSSE3 = 1u << 0,
+    CPU_SSE41 = 1u << 1,
+    CPU_AESNI = 1u << 2,
+    CPU_PCLMUL = 1u << 3,
+    CPU_AVX = 1u << 4,
+    CPU_AVX2 = 1u << 5,
+    CPU_BMI2 = 1u << 6,
+    CPU_AVX512F = 1u << 7,
+    CPU_AVX512BW = 1u << 8,
+    CPU_AVX512VL = 1u << 9,
+    CPU_GFNI = 1u << 10,
+    CPU_VAES = 1u << 11,
+    CPU_VPCLMULQDQ = 1u << 12,
+};
+
+inline void cpuidex(uint32_t leaf, uint32_t subleaf, uint32_t r[4]) {
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuidex(regs, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; i++) {
+        r[i] = (uint32_t)regs[i];
+    }
+#else
+    __cpuid_count(leaf, subleaf, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+// 读取XCR0，判断操作系统是否保存了YMM/ZMM寄存器状态
+inline uint64_t readXcr0() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+inline uint32_t detectCpuFeatures() {
+    uint32_t r[4];
+    uint32_t f = 0;
+
+    cpuidex(0, 0, r);
+    uint32_t maxLeaf = r[0];
+
+    cpuidex(1, 0, r);
+    uint32_t ecx1 = r[2];
+    if (ecx1 & (1u << 9)) f |= CPU_SSSE3;
+    if (ecx1 & (1u << 19)) f |= CPU_SSE41;
+    if (ecx1 & (1u << 25)) f |= CPU_AESNI;
+    if (ecx1 & (1u << 1)) f |= CPU_PCLMUL;
+
+    // AVX系列还需要操作系统支持 (OSXSAVE且XCR0中XMM/YMM状态位置位)
+    bool osYmm = false, osZmm = false;
+    if (ecx1 & (1u << 27)) {
+        uint64_t xcr0 = readXcr0();
+        osYmm = (xcr0 & 0x06) == 0x06;
+        osZmm = osYmm && (xcr0 & 0xE0) == 0xE0;
+    }
+    if (osYmm && (ecx1 & (1u << 28))) f |= CPU_AVX;
+
+    if (maxLeaf >= 7) {
+        cpuidex(7, 0, r);
+        uint32_t ebx7 = r[1], ecx7 = r[2];
+        if (ebx7 & (1u << 8)) f |= CPU_BMI2;
+        // SSE编码的GFNI不依赖YMM状态
+        if (ecx7 & (1u << 8)) f |= CPU_GFNI;
+        if (osYmm) {
+            if (ebx7 & (1u << 5)) f |= CPU_AVX2;
+            if (ecx7 & (1u << 9)) f |= CPU_VAES;
+            if (ecx7 & (1u << 10)) f |= CPU_VPCLMULQDQ;
+        }
+        if (osZmm) {
+            if (ebx7 & (1u << 16)) f |= CPU_AVX512F;
+            if (ebx7 & (1u << 30)) f |= CPU_AVX512BW;
+            if (ebx7 & (1u << 31)) f |= CPU_AVX512VL;
+        }
+    }
+    return f;
+}
+
+// 检测结果只计算一次
+inline uint32_t cpuFeatures() {
+    static const uint32_t features = detectCpuFeatures();
+    return features;
+}
+
+// 判断mask中的特性是否全部可用
+inline bool cpuHas(uint32_t mask) {
+    return (cpuFeatures() & mask) == mask;
+}
+
+// -------------------------- 内核自检 --------------------------
+
+// 各内核表的启动自检结果，与对应内核表一一对应、顺序相同
+struct KernelSelfTest {
+    const char* name;
+    bool supported;     // 当前CPU支持该内核，自检已执行
+    bool passed;        // 与参考实现的结果一致；不支持时为false，不参与分派
+};
+
+// 自检用的确定性伪随机字节 (xorshift64*)：每次启动检查同一组输入，失败可以复现
+inline void selfTestFill(uint8_t* p, size_t n, uint64_t& state) {
+    for (size_t i = 0; i < n; i++) {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        p[i] = (uint8_t)((state * 0x2545F4914F6CDD1Dull) >> 56);
+    }
+}
@@ -0,0 +1,913 @@
+#pragma once
+// SM4分组密码：常量、密钥扩展、各版本加密内核 (基础 / T-table / AESNI / GFNI) 与运行时分派
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <immintrin.h>
+
+#include "cpu_features.h"
+#include "sm4_tables.h"
+#include "sm4_bitslice.h"
+
+// 循环左移函数
+inline uint32_t rotl(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+// -------------------------- 基础版本 --------------------------
+
+// 基础T函数
+inline uint32_t T_basic(uint32_t x) {
+    uint32_t b0 = Sbox[(x >> 24) & 0xFF];
+    uint32_t b1 = Sbox[(x >> 16) & 0xFF];
+    uint32_t b2 = Sbox[(x >> 8) & 0xFF];
+    uint32_t b3 = Sbox[x & 0xFF];
+    uint32_t s = (b0 << 24) | (b1 << 16) | (b2 << 8) | b3;  // 正确组合字节
+
+    // 线性变换 
+    return s ^ rotl(s, 2) ^ rotl(s, 10) ^ rotl(s, 18) ^ rotl(s, 24);
+}
+
+// 基础T'函数 (用于密钥扩展)
+inline uint32_t T_prime_basic(uint32_t x) {
+    uint32_t b0 = Sbox[(x >> 24) & 0xFF];
+    uint32_t b1 = Sbox[(x >> 16) & 0xFF];
+    uint32_t b2 = Sbox[(x >> 8) & 0xFF];
+    uint32_t b3 = Sbox[x & 0xFF];
+    uint32_t s = (b0 << 24) | (b1 << 16) | (b2 << 8) | b3;  // 正确组合字节
+
+    // 线性变换 
+    return s ^ rotl(s, 13) ^ rotl(s, 23);
+}
+// 基础密钥扩展
+inline void keyExpansionBasic(const uint8_t* key, uint32_t rk[32]) {
+    uint32_t MK[4];
+    for (int i = 0; i < 4; i++) {
+        MK[i] = (key[4 * i] << 24) | (key[4 * i + 1] << 16) |
+            (key[4 * i + 2] << 8) | key[4 * i + 3];
+    }
+
+    uint32_t K[36];
+    K[0] = MK[0] ^ FK[0];
+    K[1] = MK[1] ^ FK[1];
+    K[2] = MK[2] ^ FK[2];
+    K[3] = MK[3] ^ FK[3];
+
+    for (int i = 0; i < 32; i++) {
+        K[i + 4] = K[i] ^ T_prime_basic(K[i + 1] ^ K[i + 2] ^ K[i + 3] ^ CK[i]);
+        rk[i] = K[i + 4];
+    }
+}
+
+// 基础加密函数
+inline void sm4EncryptBasic(const uint8_t* plaintext, const uint32_t rk[32], uint8_t* ciphertext) {
+    uint32_t X[36];
+    for (int i = 0; i < 4; i++) {
+        X[i] = (plaintext[4 * i] << 24) | (plaintext[4 * i + 1] << 16) |
+            (plaintext[4 * i + 2] << 8) | plaintext[4 * i + 3];
+    }
+
+    for (int i = 0; i < 32; i++) {
+        // 状态更新逻辑
+        X[i + 4] = X[i] ^ T_basic(X[i + 1] ^ X[i + 2] ^ X[i + 3] ^ rk[i]);
+    }
+
+    // 输出顺序 (修复索引)
+    for (int i = 0; i < 4; i++) {
+        uint32_t val = X[35 - i];
+        ciphertext[4 * i] = (val >> 24) & 0xFF;
+        ciphertext[4 * i + 1] = (val >> 16) & 0xFF;
+        ciphertext[4 * i + 2] = (val >> 8) & 0xFF;
+        ciphertext[4 * i + 3] = val & 0xFF;
+    }
+}
+
+// 解密轮密钥：SM4解密与加密结构相同，只是轮密钥逆序使用
+inline void sm4ReverseRoundKeys(const uint32_t rk[32], uint32_t drk[32]) {
+    for (int i = 0; i < 32; i++) {
+        drk[i] = rk[31 - i];
+    }
+}
+
+// 基础解密函数 (rk为加密轮密钥)
+inline void sm4DecryptBasic(const uint8_t* ciphertext, const uint32_t rk[32], uint8_t* plaintext) {
+    uint32_t drk[32];
+    sm4ReverseRoundKeys(rk, drk);
+    sm4EncryptBasic(ciphertext, drk, plaintext);
+}
+
+// -------------------------- T-table优化版本 --------------------------
+
+// T-table优化的T函数：四张按字节位置预先循环移位的表 (见sm4_tables.h)，
+// 每轮只有4次查表和异或
+inline uint32_t T_table_opt(uint32_t x) {
+    return sm4TLookup(x);
+}
+
+// T-table优化的密钥扩展
+inline void keyExpansionTTable(const uint8_t* key, uint32_t rk[32]) {
+    uint32_t MK[4];
+    for (int i = 0; i < 4; i++) {
+        MK[i] = (key[4 * i] << 24) | (key[4 * i + 1] << 16) | (key[4 * i + 2] << 8) | key[4 * i + 3];
+    }
+
+    uint32_t K[36];
+    K[0] = MK[0] ^ FK[0];
+    K[1] = MK[1] ^ FK[1];
+    K[2] = MK[2] ^ FK[2];
+    K[3] = MK[3] ^ FK[3];
+
+    for (int i = 0; i < 32; i++) {
+        // 密钥扩展使用L'，T表只适用于加密轮函数的L
+        K[i + 4] = K[i] ^ T_prime_basic(K[i + 1] ^ K[i + 2] ^ K[i + 3] ^ CK[i]);
+        rk[i] = K[i + 4];
+    }
+}
+
+// T-table优化的加密函数
+inline void sm4EncryptTTable(const uint8_t* plaintext, const uint32_t rk[32], uint8_t* ciphertext) {
+    uint32_t X[36];
+    for (int i = 0; i < 4; i++) {
+        X[i] = (plaintext[4 * i] << 24) | (plaintext[4 * i + 1] << 16) | (plaintext[4 * i + 2] << 8) | plaintext[4 * i + 3];
+    }
+
+    for (int i = 0; i < 32; i++) {
+        X[i + 4] = X[i] ^ T_table_opt(X[i + 1] ^ X[i + 2] ^ X[i + 3] ^ rk[i]);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        uint32_t val = X[35 - i];
+        ciphertext[4 * i] = (val >> 24) & 0xFF;
+        ciphertext[4 * i + 1] = (val >> 16) & 0xFF;
+        ciphertext[4 * i + 2] = (val >> 8) & 0xFF;
+        ciphertext[4 * i + 3] = val & 0xFF;
+    }
+}
+
+// -------------------------- 多分组交错版本 --------------------------
+
+// 大端序读取32位字
+inline uint32_t load32BE(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// 大端序写入32位字
+inline void store32BE(uint8_t* p, uint32_t v) {
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+// 16字节分组异或：out = a ^ b，out可以与a或b相同
+inline void xorBlock16(uint8_t* out, const uint8_t* a, const uint8_t* b) {
+    uint64_t a0, a1, b0, b1;
+    memcpy(&a0, a, 8);
+    memcpy(&a1, a + 8, 8);
+    memcpy(&b0, b, 8);
+    memcpy(&b1, b + 8, 8);
+    a0 ^= b0;
+    a1 ^= b1;
+    memcpy(out, &a0, 8);
+    memcpy(out + 8, &a1, 8);
+}
+
+// N个分组交错执行32轮：同一轮内N个分组的查表互不依赖，
+// CPU可以同时发出多组访存，掩盖单分组串行查表的L1延迟
+template<int N>
+inline void sm4EncryptTTableN(const uint8_t* in, const uint32_t rk[32], uint8_t* out) {
+    uint32_t X[N][4];
+    for (int b = 0; b < N; b++) {
+        for (int i = 0; i < 4; i++) {
+            X[b][i] = load32BE(in + 16 * b + 4 * i);
+        }
+    }
+
+    // 每4轮展开一次，状态字原地更新，省去移位拷贝
+    for (int i = 0; i < 32; i += 4) {
+        for (int b = 0; b < N; b++) X[b][0] ^= T_table_opt(X[b][1] ^ X[b][2] ^ X[b][3] ^ rk[i]);
+        for (int b = 0; b < N; b++) X[b][1] ^= T_table_opt(X[b][2] ^ X[b][3] ^ X[b][0] ^ rk[i + 1]);
+        for (int b = 0; b < N; b++) X[b][2] ^= T_table_opt(X[b][3] ^ X[b][0] ^ X[b][1] ^ rk[i + 2]);
+        for (int b = 0; b < N; b++) X[b][3] ^= T_table_opt(X[b][0] ^ X[b][1] ^ X[b][2] ^ rk[i + 3]);
+    }
+
+    // 反序输出 (X35, X34, X33, X32)
+    for (int b = 0; b < N; b++) {
+        for (int i = 0; i < 4; i++) {
+            store32BE(out + 16 * b + 4 * i, X[b][3 - i]);
+        }
+    }
+}
+
+// T-table批量加密：8路/4路交错处理，不足4块的尾部退回单分组函数
+inline void sm4EncryptBlocksTTable(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    while (nblocks >= 8) {
+        sm4EncryptTTableN<8>(in, rk, out);
+        in += 8 * 16;
+        out += 8 * 16;
+        nblocks -= 8;
+    }
+    if (nblocks >= 4) {
+        sm4EncryptTTableN<4>(in, rk, out);
+        in += 4 * 16;
+        out += 4 * 16;
+        nblocks -= 4;
+    }
+    while (nblocks > 0) {
+        sm4EncryptTTable(in, rk, out);
+        in += 16;
+        out += 16;
+        nblocks--;
+    }
+}
+
+// -------------------------- SIMD公共工具 --------------------------
+
+// 以下各版本内核用CPU_TARGET按函数打开指令集，不依赖编译选项；
+// 是否调用由运行时分派根据cpuid结果决定
+
+// 32位字内的字节序翻转与循环左移8/16/24位 (pshufb掩码)
+const __m128i kBswap32 = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+const __m128i kRotl8 = _mm_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+const __m128i kRotl16 = _mm_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+const __m128i kRotl24 = _mm_set_epi8(12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1);
+
+// 4x4的32位字转置：4个分组 <-> 4个字切片寄存器
+inline void transpose4x4(__m128i& a, __m128i& b, __m128i& c, __m128i& d) {
+    __m128i t0 = _mm_unpacklo_epi32(a, b);
+    __m128i t1 = _mm_unpacklo_epi32(c, d);
+    __m128i t2 = _mm_unpackhi_epi32(a, b);
+    __m128i t3 = _mm_unpackhi_epi32(c, d);
+    a = _mm_unpacklo_epi64(t0, t1);
+    b = _mm_unpackhi_epi64(t0, t1);
+    c = _mm_unpacklo_epi64(t2, t3);
+    d = _mm_unpackhi_epi64(t2, t3);
+}
+
+// 每个128位通道内做4x4转置
+CPU_TARGET("avx2")
+inline void transpose4x4_avx2(__m256i& a, __m256i& b, __m256i& c, __m256i& d) {
+    __m256i t0 = _mm256_unpacklo_epi32(a, b);
+    __m256i t1 = _mm256_unpacklo_epi32(c, d);
+    __m256i t2 = _mm256_unpackhi_epi32(a, b);
+    __m256i t3 = _mm256_unpackhi_epi32(c, d);
+    a = _mm256_unpacklo_epi64(t0, t1);
+    b = _mm256_unpackhi_epi64(t0, t1);
+    c = _mm256_unpacklo_epi64(t2, t3);
+    d = _mm256_unpackhi_epi64(t2, t3);
+}
+
+// 128/256位下的线性变换L：L(s) = s ^ rotl(s, 24) ^ rotl(s ^ rotl(s, 8) ^ rotl(s, 16), 2)
+CPU_TARGET("ssse3")
+inline __m128i linearSSSE3(__m128i s) {
+    __m128i t = _mm_xor_si128(_mm_xor_si128(s, _mm_shuffle_epi8(s, kRotl8)), _mm_shuffle_epi8(s, kRotl16));
+    t = _mm_or_si128(_mm_slli_epi32(t, 2), _mm_srli_epi32(t, 30));
+    return _mm_xor_si128(_mm_xor_si128(s, _mm_shuffle_epi8(s, kRotl24)), t);
+}
+
+CPU_TARGET("avx2")
+inline __m256i linearAVX2(__m256i s) {
+    __m256i t = _mm256_xor_si256(_mm256_xor_si256(s, _mm256_shuffle_epi8(s, _mm256_broadcastsi128_si256(kRotl8))),
+        _mm256_shuffle_epi8(s, _mm256_broadcastsi128_si256(kRotl16)));
+    t = _mm256_or_si256(_mm256_slli_epi32(t, 2), _mm256_srli_epi32(t, 30));
+    return _mm256_xor_si256(_mm256_xor_si256(s, _mm256_shuffle_epi8(s, _mm256_broadcastsi128_si256(kRotl24))), t);
+}
+
+// 任意长度的字节串异或：out = a ^ b，out可以与a或b相同。
+// 有AVX2时每次32字节，否则用SSE2每次16字节 (x86-64基线)，尾部逐字节
+CPU_TARGET("avx2")
+inline void xorBytesAVX2(uint8_t* out, const uint8_t* a, const uint8_t* b, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+        _mm256_storeu_si256((__m256i*)(out + i), x);
+    }
+    for (; i < n; i++) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+inline void xorBytesSSE2(uint8_t* out, const uint8_t* a, const uint8_t* b, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+        _mm_storeu_si128((__m128i*)(out + i), x);
+    }
+    for (; i < n; i++) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+inline void xorBytes(uint8_t* out, const uint8_t* a, const uint8_t* b, size_t n) {
+    static const bool avx2 = cpuHas(CPU_AVX2);
+    if (avx2) {
+        xorBytesAVX2(out, a, b, n);
+    }
+    else {
+        xorBytesSSE2(out, a, b, n);
+    }
+}
+
+// 常数时间比较：累积全部字节的差异后才判断，耗时与第一个不同字节的位置无关。
+// 认证标签、密钥等秘密数据的比较都用它
+inline bool sm4ConstTimeEqual(const uint8_t* a, const uint8_t* b, size_t len) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < len; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+// -------------------------- AESNI优化版本 --------------------------
+
+// SM4的S盒与AES的S盒都基于GF(2^8)求逆：S(x) = A·inv(A·x + c) + c。
+// 两个域同构，先用仿射变换把输入映射到AES域，用aesenclast完成求逆，
+// 再用仿射变换映射回来。仿射变换按高低半字节拆成两张16项表，用pshufb查表。
+// 前置变换：x -> T·A·x + T·c (T为SM4域到AES域的同构)
+const __m128i kAesniPreLo = _mm_set_epi64x(0x9814A8241D912DA1, 0x078B37BB820EB23E);
+const __m128i kAesniPreHi = _mm_set_epi64x(0x3FE311CDFA26D408, 0x37EB19C5F22EDC00);
+// 后置变换：同时抵消AES S盒自带的仿射变换
+const __m128i kAesniPostLo = _mm_set_epi64x(0x47FF8D3579C1B30B, 0x2098EA521EA6D46C);
+const __m128i kAesniPostHi = _mm_set_epi64x(0xED0DBD5D709020C0, 0x2DCD7D9DB050E000);
+// 逆ShiftRows，抵消aesenclast中的行移位
+const __m128i kAesniInvShiftRows = _mm_set_epi8(3, 6, 9, 12, 15, 2, 5, 8, 11, 14, 1, 4, 7, 10, 13, 0);
+
+// 半字节查表实现的GF(2)仿射变换
+CPU_TARGET("ssse3")
+inline __m128i affineAESNI(__m128i x, __m128i lo, __m128i hi) {
+    const __m128i mask4 = _mm_set1_epi8(0x0F);
+    __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(x, mask4));
+    __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi32(x, 4), mask4));
+    return _mm_xor_si128(l, h);
+}
+
+// 16字节并行的SM4 S盒
+CPU_TARGET("ssse3,aes")
+inline __m128i sboxAESNI(__m128i x) {
+    x = affineAESNI(x, kAesniPreLo, kAesniPreHi);
+    x = _mm_shuffle_epi8(x, kAesniInvShiftRows);
+    x = _mm_aesenclast_si128(x, _mm_setzero_si128());
+    return affineAESNI(x, kAesniPostLo, kAesniPostHi);
+}
+
+// AESNI优化的T函数：S盒 + 线性变换L
+CPU_TARGET("ssse3,aes")
+inline __m128i T_aesni(__m128i x) {
+    return linearSSSE3(sboxAESNI(x));
+}
+
+// AESNI优化的密钥扩展 (S盒走AES指令，其余为标量计算)
+CPU_TARGET("ssse3,aes")
+inline void keyExpansionAESNI(const uint8_t* key, uint32_t rk[32]) {
+    uint32_t K[4];
+    for (int i = 0; i < 4; i++) {
+        K[i] = load32BE(key + 4 * i) ^ FK[i];
+    }
+
+    for (int i = 0; i < 32; i++) {
+        uint32_t tmp = K[(i + 1) % 4] ^ K[(i + 2) % 4] ^ K[(i + 3) % 4] ^ CK[i];
+        uint32_t s = (uint32_t)_mm_cvtsi128_si32(sboxAESNI(_mm_cvtsi32_si128((int)tmp)));
+        K[i % 4] ^= s ^ rotl(s, 13) ^ rotl(s, 23);
+        rk[i] = K[i % 4];
+    }
+}
+
+// 4路AESNI内核：每个寄存器保存4个分组的同一个字
+CPU_TARGET("ssse3,aes")
+inline void sm4EncryptAESNI4(const uint8_t* in, const uint32_t rk[32], uint8_t* out) {
+    __m128i X0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 0)), kBswap32);
+    __m128i X1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 16)), kBswap32);
+    __m128i X2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 32)), kBswap32);
+    __m128i X3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 48)), kBswap32);
+    transpose4x4(X0, X1, X2, X3);
+
+    for (int i = 0; i < 32; i += 4) {
+        X0 = _mm_xor_si128(X0, T_aesni(_mm_xor_si128(_mm_xor_si128(X1, X2), _mm_xor_si128(X3, _mm_set1_epi32((int)rk[i])))));
+        X1 = _mm_xor_si128(X1, T_aesni(_mm_xor_si128(_mm_xor_si128(X2, X3), _mm_xor_si128(X0, _mm_set1_epi32((int)rk[i + 1])))));
+        X2 = _mm_xor_si128(X2, T_aesni(_mm_xor_si128(_mm_xor_si128(X3, X0), _mm_xor_si128(X1, _mm_set1_epi32((int)rk[i + 2])))));
+        X3 = _mm_xor_si128(X3, T_aesni(_mm_xor_si128(_mm_xor_si128(X0, X1), _mm_xor_si128(X2, _mm_set1_epi32((int)rk[i + 3])))));
+    }
+
+    // 反序输出 (X35, X34, X33, X32)
+    transpose4x4(X3, X2, X1, X0);
+    _mm_storeu_si128((__m128i*)(out + 0), _mm_shuffle_epi8(X3, kBswap32));
+    _mm_storeu_si128((__m128i*)(out + 16), _mm_shuffle_epi8(X2, kBswap32));
+    _mm_storeu_si128((__m128i*)(out + 32), _mm_shuffle_epi8(X1, kBswap32));
+    _mm_storeu_si128((__m128i*)(out + 48), _mm_shuffle_epi8(X0, kBswap32));
+}
+
+// AESNI批量加密：4路处理，不足4块的尾部补齐后仍走AESNI内核
+CPU_TARGET("ssse3,aes")
+inline void sm4EncryptBlocksAESNI(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    while (nblocks >= 4) {
+        sm4EncryptAESNI4(in, rk, out);
+        in += 4 * 16;
+        out += 4 * 16;
+        nblocks -= 4;
+    }
+    if (nblocks > 0) {
+        uint8_t buf[4 * 16] = { 0 };
+        memcpy(buf, in, nblocks * 16);
+        sm4EncryptAESNI4(buf, rk, buf);
+        memcpy(out, buf, nblocks * 16);
+    }
+}
+
+// AESNI优化的加密函数 (单块)
+inline void sm4EncryptAESNI(const uint8_t* plaintext, const uint32_t rk[32], uint8_t* ciphertext) {
+    sm4EncryptBlocksAESNI(rk, plaintext, ciphertext, 1);
+}
+
+// AVX2下的256位版本：pshufb按128位通道查表
+CPU_TARGET("avx2")
+inline __m256i affineAVX2(__m256i x, __m128i lo, __m128i hi) {
+    const __m256i mask4 = _mm256_set1_epi8(0x0F);
+    __m256i l = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(lo), _mm256_and_si256(x, mask4));
+    __m256i h = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(hi), _mm256_and_si256(_mm256_srli_epi32(x, 4), mask4));
+    return _mm256_xor_si256(l, h);
+}
+
+// 没有VAES时aesenclast只能处理128位，拆成两半执行
+CPU_TARGET("avx2,aes")
+inline __m256i sboxAESNI_AVX2(__m256i x) {
+    x = affineAVX2(x, kAesniPreLo, kAesniPreHi);
+    x = _mm256_shuffle_epi8(x, _mm256_broadcastsi128_si256(kAesniInvShiftRows));
+    __m128i lo = _mm_aesenclast_si128(_mm256_castsi256_si128(x), _mm_setzero_si128());
+    __m128i hi = _mm_aesenclast_si128(_mm256_extracti128_si256(x, 1), _mm_setzero_si128());
+    x = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    return affineAVX2(x, kAesniPostLo, kAesniPostHi);
+}
+
+CPU_TARGET("avx2,aes")
+inline __m256i T_aesni_avx2(__m256i x) {
+    return linearAVX2(sboxAESNI_AVX2(x));
+}
+
+// 8路AESNI+AVX2内核
+CPU_TARGET("avx2,aes")
+inline void sm4EncryptAESNI8(const uint8_t* in, const uint32_t rk[32], uint8_t* out) {
+    const __m256i bswap = _mm256_broadcastsi128_si256(kBswap32);
+    __m256i X0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 0)), bswap);
+    __m256i X1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 32)), bswap);
+    __m256i X2 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 64)), bswap);
+    __m256i X3 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 96)), bswap);
+    transpose4x4_avx2(X0, X1, X2, X3);
+
+    for (int i = 0; i < 32; i += 4) {
+        X0 = _mm256_xor_si256(X0, T_aesni_avx2(_mm256_xor_si256(_mm256_xor_si256(X1, X2), _mm256_xor_si256(X3, _mm256_set1_epi32((int)rk[i])))));
+        X1 = _mm256_xor_si256(X1, T_aesni_avx2(_mm256_xor_si256(_mm256_xor_si256(X2, X3), _mm256_xor_si256(X0, _mm256_set1_epi32((int)rk[i + 1])))));
+        X2 = _mm256_xor_si256(X2, T_aesni_avx2(_mm256_xor_si256(_mm256_xor_si256(X3, X0), _mm256_xor_si256(X1, _mm256_set1_epi32((int)rk[i + 2])))));
+        X3 = _mm256_xor_si256(X3, T_aesni_avx2(_mm256_xor_si256(_mm256_xor_si256(X0, X1), _mm256_xor_si256(X2, _mm256_set1_epi32((int)rk[i + 3])))));
+    }
+
+    transpose4x4_avx2(X3, X2, X1, X0);
+    _mm256_storeu_si256((__m256i*)(out + 0), _mm256_shuffle_epi8(X3, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 32), _mm256_shuffle_epi8(X2, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 64), _mm256_shuffle_epi8(X1, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 96), _mm256_shuffle_epi8(X0, bswap));
+}
+
+CPU_TARGET("avx2,aes")
+inline void sm4EncryptBlocksAESNI_AVX2(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    while (nblocks >= 8) {
+        sm4EncryptAESNI8(in, rk, out);
+        in += 8 * 16;
+        out += 8 * 16;
+        nblocks -= 8;
+    }
+    sm4EncryptBlocksAESNI(rk, in, out, nblocks);
+}
+
+// 有VAES时256位aesenclast一次处理两个通道
+CPU_TARGET("avx2,aes,vaes")
+inline __m256i T_vaes_avx2(__m256i x) {
+    x = affineAVX2(x, kAesniPreLo, kAesniPreHi);
+    x = _mm256_shuffle_epi8(x, _mm256_broadcastsi128_si256(kAesniInvShiftRows));
+    x = _mm256_aesenclast_epi128(x, _mm256_setzero_si256());
+    return linearAVX2(affineAVX2(x, kAesniPostLo, kAesniPostHi));
+}
+
+// 8路VAES+AVX2内核
+CPU_TARGET("avx2,aes,vaes")
+inline void sm4EncryptVAES8(const uint8_t* in, const uint32_t rk[32], uint8_t* out) {
+    const __m256i bswap = _mm256_broadcastsi128_si256(kBswap32);
+    __m256i X0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 0)), bswap);
+    __m256i X1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 32)), bswap);
+    __m256i X2 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 64)), bswap);
+    __m256i X3 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 96)), bswap);
+    transpose4x4_avx2(X0, X1, X2, X3);
+
+    for (int i = 0; i < 32; i += 4) {
+        X0 = _mm256_xor_si256(X0, T_vaes_avx2(_mm256_xor_si256(_mm256_xor_si256(X1, X2), _mm256_xor_si256(X3, _mm256_set1_epi32((int)rk[i])))));
+        X1 = _mm256_xor_si256(X1, T_vaes_avx2(_mm256_xor_si256(_mm256_xor_si256(X2, X3), _mm256_xor_si256(X0, _mm256_set1_epi32((int)rk[i + 1])))));
+        X2 = _mm256_xor_si256(X2, T_vaes_avx2(_mm256_xor_si256(_mm256_xor_si256(X3, X0), _mm256_xor_si256(X1, _mm256_set1_epi32((int)rk[i + 2])))));
+        X3 = _mm256_xor_si256(X3, T_vaes_avx2(_mm256_xor_si256(_mm256_xor_si256(X0, X1), _mm256_xor_si256(X2, _mm256_set1_epi32((int)rk[i + 3])))));
+    }
+
+    transpose4x4_avx2(X3, X2, X1, X0);
+    _mm256_storeu_si256((__m256i*)(out + 0), _mm256_shuffle_epi8(X3, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 32), _mm256_shuffle_epi8(X2, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 64), _mm256_shuffle_epi8(X1, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 96), _mm256_shuffle_epi8(X0, bswap));
+}
+
+CPU_TARGET("avx2,aes,vaes")
+inline void sm4EncryptBlocksVAES_AVX2(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    while (nblocks >= 8) {
+        sm4EncryptVAES8(in, rk, out);
+        in += 8 * 16;
+        out += 8 * 16;
+        nblocks -= 8;
+    }
+    sm4EncryptBlocksAESNI(rk, in, out, nblocks);
+}
+
+// -------------------------- GFNI和VPROLD优化版本 --------------------------
+
+// gf2p8affineinv先在AES域求逆再做仿射变换，因此S(x) = A·inv(A·x + c) + c拆成：
+// 前置仿射 x -> T·A·x + T·c，求逆后再做后置仿射 y -> A·T^-1·y + c (T为SM4域到AES域的同构)
+// 矩阵按GFNI约定编码：第i个输出位对应qword中的第7-i字节
+const long long kGfniPreMatrix = 0x4C287DB91A22505D;
+const int kGfniPreConst = 0x3E;
+const long long kGfniPostMatrix = 0xF3AB34A974A6B589;
+const int kGfniPostConst = 0xD3;
+
+// 16字节并行的SM4 S盒
+CPU_TARGET("gfni")
+inline __m128i sboxGFNI(__m128i x) {
+    x = _mm_gf2p8affine_epi64_epi8(x, _mm_set1_epi64x(kGfniPreMatrix), kGfniPreConst);
+    return _mm_gf2p8affineinv_epi64_epi8(x, _mm_set1_epi64x(kGfniPostMatrix), kGfniPostConst);
+}
+
+// GFNI优化的T函数 (128位)：没有AVX-512时用pshufb和移位完成循环左移
+CPU_TARGET("ssse3,gfni")
+inline __m128i T_gfni(__m128i x) {
+    return linearSSSE3(sboxGFNI(x));
+}
+
+// GFNI和VPROLD优化的密钥扩展 (S盒走GFNI指令，其余为标量计算)
+CPU_TARGET("gfni")
+inline void keyExpansionGFNI(const uint8_t* key, uint32_t rk[32]) {
+    uint32_t K[4];
+    for (int i = 0; i < 4; i++) {
+        K[i] = load32BE(key + 4 * i) ^ FK[i];
+    }
+
+    for (int i = 0; i < 32; i++) {
+        uint32_t tmp = K[(i + 1) % 4] ^ K[(i + 2) % 4] ^ K[(i + 3) % 4] ^ CK[i];
+        uint32_t s = (uint32_t)_mm_cvtsi128_si32(sboxGFNI(_mm_cvtsi32_si128((int)tmp)));
+        K[i % 4] ^= s ^ rotl(s, 13) ^ rotl(s, 23);
+        rk[i] = K[i % 4];
+    }
+}
+
+// 4路GFNI内核 (仅有SSE级GFNI的CPU)
+CPU_TARGET("ssse3,gfni")
+inline void sm4EncryptGFNI4(const uint8_t* in, const uint32_t rk[32], uint8_t* out) {
+    __m128i X0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 0)), kBswap32);
+    __m128i X1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 16)), kBswap32);
+    __m128i X2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 32)), kBswap32);
+    __m128i X3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 48)), kBswap32);
+    transpose4x4(X0, X1, X2, X3);
+
+    for (int i = 0; i < 32; i += 4) {
+        X0 = _mm_xor_si128(X0, T_gfni(_mm_xor_si128(_mm_xor_si128(X1, X2), _mm_xor_si128(X3, _mm_set1_epi32((int)rk[i])))));
+        X1 = _mm_xor_si128(X1, T_gfni(_mm_xor_si128(_mm_xor_si128(X2, X3), _mm_xor_si128(X0, _mm_set1_epi32((int)rk[i + 1])))));
+        X2 = _mm_xor_si128(X2, T_gfni(_mm_xor_si128(_mm_xor_si128(X3, X0), _mm_xor_si128(X1, _mm_set1_epi32((int)rk[i + 2])))));
+        X3 = _mm_xor_si128(X3, T_gfni(_mm_xor_si128(_mm_xor_si128(X0, X1), _mm_xor_si128(X2, _mm_set1_epi32((int)rk[i + 3])))));
+    }
+
+    transpose4x4(X3, X2, X1, X0);
+    _mm_storeu_si128((__m128i*)(out + 0), _mm_shuffle_epi8(X3, kBswap32));
+    _mm_storeu_si128((__m128i*)(out + 16), _mm_shuffle_epi8(X2, kBswap32));
+    _mm_storeu_si128((__m128i*)(out + 32), _mm_shuffle_epi8(X1, kBswap32));
+    _mm_storeu_si128((__m128i*)(out + 48), _mm_shuffle_epi8(X0, kBswap32));
+}
+
+// GFNI批量加密：4路处理，尾部补齐后仍走GFNI内核
+CPU_TARGET("ssse3,gfni")
+inline void sm4EncryptBlocksGFNI(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    while (nblocks >= 4) {
+        sm4EncryptGFNI4(in, rk, out);
+        in += 4 * 16;
+        out += 4 * 16;
+        nblocks -= 4;
+    }
+    if (nblocks > 0) {
+        uint8_t buf[4 * 16] = { 0 };
+        memcpy(buf, in, nblocks * 16);
+        sm4EncryptGFNI4(buf, rk, buf);
+        memcpy(out, buf, nblocks * 16);
+    }
+}
+
+// GFNI和VPROLD优化的加密函数 (单块)
+inline void sm4EncryptGFNI(const uint8_t* plaintext, const uint32_t rk[32], uint8_t* ciphertext) {
+    sm4EncryptBlocksGFNI(rk, plaintext, ciphertext, 1);
+}
+
+// GFNI优化的T函数 (256位)
+CPU_TARGET("avx2,gfni")
+inline __m256i sboxGFNI_AVX2(__m256i x) {
+    x = _mm256_gf2p8affine_epi64_epi8(x, _mm256_set1_epi64x(kGfniPreMatrix), kGfniPreConst);
+    return _mm256_gf2p8affineinv_epi64_epi8(x, _mm256_set1_epi64x(kGfniPostMatrix), kGfniPostConst);
+}
+
+CPU_TARGET("avx2,gfni")
+inline __m256i T_gfni_avx2(__m256i x) {
+    return linearAVX2(sboxGFNI_AVX2(x));
+}
+
+// 8路GFNI+AVX2内核
+CPU_TARGET("avx2,gfni")
+inline void sm4EncryptGFNI8(const uint8_t* in, const uint32_t rk[32], uint8_t* out) {
+    const __m256i bswap = _mm256_broadcastsi128_si256(kBswap32);
+    __m256i X0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 0)), bswap);
+    __m256i X1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 32)), bswap);
+    __m256i X2 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 64)), bswap);
+    __m256i X3 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 96)), bswap);
+    transpose4x4_avx2(X0, X1, X2, X3);
+
+    for (int i = 0; i < 32; i += 4) {
+        X0 = _mm256_xor_si256(X0, T_gfni_avx2(_mm256_xor_si256(_mm256_xor_si256(X1, X2), _mm256_xor_si256(X3, _mm256_set1_epi32((int)rk[i])))));
+        X1 = _mm256_xor_si256(X1, T_gfni_avx2(_mm256_xor_si256(_mm256_xor_si256(X2, X3), _mm256_xor_si256(X0, _mm256_set1_epi32((int)rk[i + 1])))));
+        X2 = _mm256_xor_si256(X2, T_gfni_avx2(_mm256_xor_si256(_mm256_xor_si256(X3, X0), _mm256_xor_si256(X1, _mm256_set1_epi32((int)rk[i + 2])))));
+        X3 = _mm256_xor_si256(X3, T_gfni_avx2(_mm256_xor_si256(_mm256_xor_si256(X0, X1), _mm256_xor_si256(X2, _mm256_set1_epi32((int)rk[i + 3])))));
+    }
+
+    transpose4x4_avx2(X3, X2, X1, X0);
+    _mm256_storeu_si256((__m256i*)(out + 0), _mm256_shuffle_epi8(X3, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 32), _mm256_shuffle_epi8(X2, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 64), _mm256_shuffle_epi8(X1, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 96), _mm256_shuffle_epi8(X0, bswap));
+}
+
+CPU_TARGET("avx2,gfni")
+inline void sm4EncryptBlocksGFNI_AVX2(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    while (nblocks >= 8) {
+        sm4EncryptGFNI8(in, rk, out);
+        in += 8 * 16;
+        out += 8 * 16;
+        nblocks -= 8;
+    }
+    sm4EncryptBlocksGFNI(rk, in, out, nblocks);
+}
+
+// GFNI优化的T函数 (512位)：VPROLD直接完成循环左移，三输入异或用vpternlogd
+CPU_TARGET("avx512f,avx512bw,gfni")
+inline __m512i sboxGFNI_AVX512(__m512i x) {
+    x = _mm512_gf2p8affine_epi64_epi8(x, _mm512_set1_epi64(kGfniPreMatrix), kGfniPreConst);
+    return _mm512_gf2p8affineinv_epi64_epi8(x, _mm512_set1_epi64(kGfniPostMatrix), kGfniPostConst);
+}
+
+CPU_TARGET("avx512f,avx512bw,gfni")
+inline __m512i T_gfni_avx512(__m512i x) {
+    __m512i s = sboxGFNI_AVX512(x);
+    __m512i t = _mm512_ternarylogic_epi32(s, _mm512_rol_epi32(s, 2), _mm512_rol_epi32(s, 10), 0x96);
+    return _mm512_ternarylogic_epi32(t, _mm512_rol_epi32(s, 18), _mm512_rol_epi32(s, 24), 0x96);
+}
+
+// 每个128位通道内做4x4转置
+CPU_TARGET("avx512f")
+inline void transpose4x4_avx512(__m512i& a, __m512i& b, __m512i& c, __m512i& d) {
+    __m512i t0 = _mm512_unpacklo_epi32(a, b);
+    __m512i t1 = _mm512_unpacklo_epi32(c, d);
+    __m512i t2 = _mm512_unpackhi_epi32(a, b);
+    __m512i t3 = _mm512_unpackhi_epi32(c, d);
+    a = _mm512_unpacklo_epi64(t0, t1);
+    b = _mm512_unpackhi_epi64(t0, t1);
+    c = _mm512_unpacklo_epi64(t2, t3);
+    d = _mm512_unpackhi_epi64(t2, t3);
+}
+
+// 32轮迭代：X0 ~ X3为转置后的4个字 (每个zmm保存16个分组的同一个字)
+CPU_TARGET("avx512f,avx512bw,gfni")
+inline void sm4RoundsGFNI16(__m512i& X0, __m512i& X1, __m512i& X2, __m512i& X3, const uint32_t rk[32]) {
+    for (int i = 0; i < 32; i += 4) {
+        X0 = _mm512_xor_si512(X0, T_gfni_avx512(_mm512_xor_si512(_mm512_ternarylogic_epi32(X1, X2, X3, 0x96), _mm512_set1_epi32((int)rk[i]))));
+        X1 = _mm512_xor_si512(X1, T_gfni_avx512(_mm512_xor_si512(_mm512_ternarylogic_epi32(X2, X3, X0, 0x96), _mm512_set1_epi32((int)rk[i + 1]))));
+        X2 = _mm512_xor_si512(X2, T_gfni_avx512(_mm512_xor_si512(_mm512_ternarylogic_epi32(X3, X0, X1, 0x96), _mm512_set1_epi32((int)rk[i + 2]))));
+        X3 = _mm512_xor_si512(X3, T_gfni_avx512(_mm512_xor_si512(_mm512_ternarylogic_epi32(X0, X1, X2, 0x96), _mm512_set1_epi32((int)rk[i + 3]))));
+    }
+}
+
+// 16路GFNI+AVX-512内核：每个zmm寄存器保存16个分组的同一个字
+CPU_TARGET("avx512f,avx512bw,gfni")
+inline void sm4EncryptGFNI16(const uint8_t* in, const uint32_t rk[32], uint8_t* out) {
+    const __m512i bswap = _mm512_broadcast_i32x4(kBswap32);
+    __m512i X0 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(in + 0)), bswap);
+    __m512i X1 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(in + 64)), bswap);
+    __m512i X2 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(in + 128)), bswap);
+    __m512i X3 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(in + 192)), bswap);
+    transpose4x4_avx512(X0, X1, X2, X3);
+
+    sm4RoundsGFNI16(X0, X1, X2, X3, rk);
+
+    transpose4x4_avx512(X3, X2, X1, X0);
+    _mm512_storeu_si512((void*)(out + 0), _mm512_shuffle_epi8(X3, bswap));
+    _mm512_storeu_si512((void*)(out + 64), _mm512_shuffle_epi8(X2, bswap));
+    _mm512_storeu_si512((void*)(out + 128), _mm512_shuffle_epi8(X1, bswap));
+    _mm512_storeu_si512((void*)(out + 192), _mm512_shuffle_epi8(X0, bswap));
+}
+
+CPU_TARGET("avx2,avx512f,avx512bw,gfni")
+inline void sm4EncryptBlocksGFNI_AVX512(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    while (nblocks >= 16) {
+        sm4EncryptGFNI16(in, rk, out);
+        in += 16 * 16;
+        out += 16 * 16;
+        nblocks -= 16;
+    }
+    sm4EncryptBlocksGFNI_AVX2(rk, in, out, nblocks);
+}
+
+// -------------------------- 运行时内核分派 --------------------------
+
+// 批量加密内核的统一接口，in与out可以指向同一缓冲区
+typedef void (*Sm4BlocksFunc)(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks);
+
+struct Sm4Kernel {
+    const char* name;               // 内核名，可通过环境变量SM4_KERNEL指定
+    uint32_t required;              // 所需CPU特性 (CpuFeature位掩码)
+    bool constant_time;             // 没有依赖密钥或数据的查表与分支
+    Sm4BlocksFunc encrypt_blocks;
+    size_t batch_blocks;            // 每次调用达到满速所需的分组数，分批调用内核的模式按它确定批量
+};
+
+// 各内核batch_blocks的上限 (512路位切片内核的一批，8 KiB)
+const size_t kSm4MaxBatch = 512;
+
+// 基础版本的批量包装，便于与其他内核做对照
+inline void sm4EncryptBlocksBasic(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    for (size_t i = 0; i < nblocks; i++) {
+        sm4EncryptBasic(in + 16 * i, rk, out + 16 * i);
+    }
+}
+
+// 按优先级从高到低排列，自动选择时取第一个CPU支持的内核。
+// 位切片内核每次至少处理64个分组，短消息上不如T-table，因此排在ttable之后，
+// 只在常数时间策略下 (或显式指定时) 才会被选中
+inline constexpr Sm4Kernel kSm4Kernels[] = {
+    { "gfni-avx512", CPU_GFNI | CPU_AVX512F | CPU_AVX512BW, true, sm4EncryptBlocksGFNI_AVX512, 64 },
+    { "gfni-avx2", CPU_GFNI | CPU_AVX2, true, sm4EncryptBlocksGFNI_AVX2, 64 },
+    { "vaes-avx2", CPU_VAES | CPU_AESNI | CPU_AVX2, true, sm4EncryptBlocksVAES_AVX2, 64 },
+    { "aesni-avx2", CPU_AESNI | CPU_AVX2, true, sm4EncryptBlocksAESNI_AVX2, 64 },
+    { "gfni", CPU_GFNI | CPU_SSSE3, true, sm4EncryptBlocksGFNI, 64 },
+    { "aesni", CPU_AESNI | CPU_SSSE3, true, sm4EncryptBlocksAESNI, 64 },
+    { "ttable", 0, false, sm4EncryptBlocksTTable, 64 },
+    { "bitslice-avx512", CPU_AVX512F | CPU_AVX2, true, sm4EncryptBlocksBitslice512, 512 },
+    { "bitslice-avx2", CPU_AVX2, true, sm4EncryptBlocksBitslice256, 256 },
+    { "bitslice-sse2", 0, true, sm4EncryptBlocksBitslice128, 128 },
+    { "bitslice64", 0, true, sm4EncryptBlocksBitslice64, 64 },
+    { "basic", 0, false, sm4EncryptBlocksBasic, 64 },
+};
+
+inline const Sm4Kernel* sm4FindKernel(const char* name) {
+    for (const Sm4Kernel& k : kSm4Kernels) {
+        if (strcmp(k.name, name) == 0) {
+            return &k;
+        }
+    }
+    return nullptr;
+}
+
+// 批量内核函数的首选批量：表中没有的函数 (调用者自带的内核) 按64个分组
+inline size_t sm4KernelBatch(Sm4BlocksFunc f) {
+    for (const Sm4Kernel& k : kSm4Kernels) {
+        if (k.encrypt_blocks == f) {
+            return k.batch_blocks;
+        }
+    }
+    return 64;
+}
+
+// -------------------------- 内核自检 --------------------------
+
+// GB/T 32907附录A.1的标准数据 (明文与密钥相同)
+const uint8_t kSm4TestKey[16] = {
+    0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0xFE, 0xDC, 0xBA, 0x98, 0x76, 0x54, 0x32, 0x10
+};
+const uint8_t kSm4TestCipher[16] = {
+    0x68, 0x1E, 0xDF, 0x34, 0xD2, 0x06, 0x96, 0x5E, 0x86, 0xB3, 0xE9, 0x4F, 0x53, 0x6E, 0x42, 0x46
+};
+
+// 随机用例的分组数：覆盖16/8/4路整批、位切片的64 ~ 512块整批以及各种长度的尾部
+const size_t kSm4SelfTestSizes[] = { 512, 256, 131, 64, 17, 3, 1 };
+
+struct Sm4SelfTestCase {
+    uint32_t rk[32];
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> ref;   // sm4EncryptBasic的结果
+};
+
+// 标准数据加密后再用逆序轮密钥解密回明文，随机用例逐字节对照参考结果
+inline bool sm4SelfTestKernel(Sm4BlocksFunc f, const std::vector<Sm4SelfTestCase>& cases) {
+    uint32_t rk[32], drk[32];
+    uint8_t buf[16];
+    keyExpansionBasic(kSm4TestKey, rk);
+    sm4ReverseRoundKeys(rk, drk);
+    f(rk, kSm4TestKey, buf, 1);
+    if (memcmp(buf, kSm4TestCipher, 16) != 0) {
+        return false;
+    }
+    f(drk, buf, buf, 1);
+    if (memcmp(buf, kSm4TestKey, 16) != 0) {
+        return false;
+    }
+
+    std::vector<uint8_t> out;
+    for (const Sm4SelfTestCase& c : cases) {
+        out.assign(c.in.size(), 0);
+        f(c.rk, c.in.data(), out.data(), c.in.size() / 16);
+        if (out != c.ref) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 参考结果只算一次，所有CPU支持的内核都对照同一组用例
+inline std::vector<KernelSelfTest> sm4RunSelfTest() {
+    uint64_t seed = 0x534D342D54455354ull;
+    std::vector<Sm4SelfTestCase> cases(sizeof(kSm4SelfTestSizes) / sizeof(kSm4SelfTestSizes[0]));
+    for (size_t i = 0; i < cases.size(); i++) {
+        Sm4SelfTestCase& c = cases[i];
+        uint8_t key[16];
+        selfTestFill(key, 16, seed);
+        keyExpansionBasic(key, c.rk);
+        c.in.resize(16 * kSm4SelfTestSizes[i]);
+        c.ref.resize(c.in.size());
+        selfTestFill(c.in.data(), c.in.size(), seed);
+        sm4EncryptBlocksBasic(c.rk, c.in.data(), c.ref.data(), kSm4SelfTestSizes[i]);
+    }
+
+    std::vector<KernelSelfTest> results;
+    for (const Sm4Kernel& k : kSm4Kernels) {
+        bool supported = cpuHas(k.required);
+        results.push_back({ k.name, supported, supported && sm4SelfTestKernel(k.encrypt_blocks, cases) });
+    }
+    return results;
+}
+
+// 自检结果，顺序与kSm4Kernels相同。首次调用时执行 (即进程启动选择内核时)
+inline const std::vector<KernelSelfTest>& sm4SelfTestResults() {
+    static const std::vector<KernelSelfTest> results = sm4RunSelfTest();
+    return results;
+}
+
+// CPU支持且通过自检的内核才参与分派
+inline bool sm4KernelUsable(const Sm4Kernel& k) {
+    return sm4SelfTestResults()[&k - kSm4Kernels].passed;
+}
+
+// 常数时间策略：环境变量SM4_CONSTANT_TIME非空且不为"0"时，只允许constant_time内核
+inline bool sm4ConstantTimePolicy() {
+    const char* v = getenv("SM4_CONSTANT_TIME");
+    return v != nullptr && v[0] != '\0' && strcmp(v, "0") != 0;
+}
+
+// 选择内核：环境变量SM4_KERNEL可强制指定 (便于A/B测试)，
+// 指定的内核不存在、当前CPU不支持、未通过自检或违反常数时间策略时退回自动选择
+inline const Sm4Kernel* sm4SelectKernel() {
+    bool ct = sm4ConstantTimePolicy();
+    const char* forced = getenv("SM4_KERNEL");
+    if (forced != nullptr && forced[0] != '\0') {
+        const Sm4Kernel* k = sm4FindKernel(forced);
+        if (k != nullptr && sm4KernelUsable(*k) && (!ct || k->constant_time)) {
+            return k;
+        }
+        fprintf(stderr, "SM4_KERNEL=%s 不存在、当前CPU不支持、未通过自检或不满足常数时间要求，改为自动选择\n", forced);
+    }
+
+    for (const Sm4Kernel& k : kSm4Kernels) {
+        if (sm4KernelUsable(k) && (!ct || k.constant_time)) {
+            return &k;
+        }
+    }
+    return sm4FindKernel(ct ? "bitslice64" : "basic");
+}
+
+// 进程启动时完成一次选择，之后只经函数指针调用
+inline const Sm4Kernel* const g_sm4Kernel = sm4SelectKernel();
+
+// 当前使用的内核名
+inline const char* sm4_kernel_name() {
+    return g_sm4Kernel->name;
+}
+
+// 批量加密接口：调用分派选定的内核
+inline void sm4_encrypt_blocks(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    g_sm4Kernel->encrypt_blocks(rk, in, out, nblocks);
+}
+
+// 批量解密接口：rk为加密轮密钥，逆序后交给同一个内核。
+// 反复解密时应使用Sm4Key (sm4_key.h) 中预先逆序的轮密钥
+inline void sm4_decrypt_blocks(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    uint32_t drk[32];
+    sm4ReverseRoundKeys(rk, drk);
+    g_sm4Kernel->encrypt_blocks(drk, in, out, nblocks);
+}
@@ -0,0 +1,344 @@
+// SM4内核基准测试：对每个内核、每种模式扫描16 B ~ 64 MiB的消息长度，
+// 报告cycles/byte (rdtsc) 和 GB/s，并与sm4EncryptBasic的结果逐字节比较
+//
+// 编译：g++ -O2 -std=c++17 sm4_bench.cpp -o sm4_bench
+// 用法：sm4_bench [--format text|json|csv] [--output 文件] [--cpu N]
+//                 [--kernels a,b,...] [--modes ecb,ctr,cbcdec,gmac,cmac,cmac16] [--max-size 字节] [--min-time 秒]
+// 任一内核结果与基础版本不一致时返回1
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <sched.h>
+#include <x86intrin.h>
+#endif
+
+#include "sm4.h"
+#include "sm4_cbc.h"
+#include "sm4_ctr.h"
+#include "sm4_mac.h"
+
+using namespace std;
+
+// -------------------------- 模式注册表 --------------------------
+
+// 每种模式把len字节的in处理到out，内部通过内核k调用分组加密；
+// len为16的整数倍，in与out不重叠
+typedef void (*BenchModeFunc)(const Sm4Kernel& k, const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t len);
+
+struct BenchMode {
+    const char* name;
+    BenchModeFunc run;
+    size_t tagBytes;    // 0：输出len字节，前缀只取决于输入前缀；否则只输出这么多字节的标签 (MAC)
+};
+
+static void benchEcb(const Sm4Kernel& k, const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t len) {
+    k.encrypt_blocks(rk, in, out, len / 16);
+}
+
+// CTR：Sm4Ctr流式接口，一次update处理整条消息
+static void benchCtr(const Sm4Kernel& k, const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t len) {
+    const uint8_t iv[16] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0xFE, 0xDC, 0xBA, 0x98, 0x00, 0x00, 0x00, 0x00 };
+    Sm4Ctr ctr(rk, iv, SM4_CTR_INC128, k.encrypt_blocks);
+    ctr.update(in, out, len);
+}
+
+// CBC解密：每批按内核的batch_blocks交给内核一次，再与前一个密文分组异或
+static void benchCbcDec(const Sm4Kernel& k, const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t len) {
+    uint32_t drk[32];
+    sm4ReverseRoundKeys(rk, drk);
+    uint8_t iv[16] = { 0 };
+    sm4CbcDecryptWith(k.encrypt_blocks, drk, iv, in, out, len / 16);
+}
+
+// GMAC：只有H和E_K(J0)两个分组经过SM4内核，吞吐量取决于自动选择的GHASH内核
+static void benchGmac(const Sm4Kernel& k, const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t len) {
+    const uint8_t iv[12] = { 0x00, 0x00, 0x12, 0x34, 0x56, 0x78, 0x00, 0x00, 0x00, 0x00, 0xAB, 0xCD };
+    Sm4GcmKey key;
+    uint8_t h[16] = { 0 };
+    key.key.setRoundKeys(rk);
+    k.encrypt_blocks(rk, h, h, 1);
+    ghashInit(key.H, gf128Load(h));
+    Sm4Gmac mac;
+    mac.init(key, iv, sizeof(iv));
+    mac.update(in, len);
+    mac.finalize(out);
+}
+
+// CMAC单流：每个分组依赖上一个分组，内核每次只加密一个分组
+static void benchCmac(const Sm4Kernel& k, const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t len) {
+    Sm4CmacKey key;
+    key.setRoundKeys(rk);
+    Sm4Cmac mac;
+    mac.init(key, k.encrypt_blocks);
+    mac.update(in, len);
+    mac.finalize(out);
+}
+
+// CMAC多流：消息等分成16条，由同名的多路内核交错推进，16个标签依次输出；
+// 没有多路版本的内核 (位切片、基础版本) 逐条串行计算
+const size_t kBenchCmacStreams = 16;
+
+static void benchCmacStreams(const Sm4Kernel& k, const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t len) {
+    Sm4CmacKey key;
+    key.setRoundKeys(rk);
+    const Sm4LaneKernel* lk = sm4FindLaneKernel(k.name);
+    Sm4Cmac macs[kBenchCmacStreams];
+    Sm4CmacStream streams[kBenchCmacStreams];
+    size_t per = len / kBenchCmacStreams;
+    for (size_t i = 0; i < kBenchCmacStreams; i++) {
+        macs[i].init(key, k.encrypt_blocks);
+        streams[i] = { &macs[i], in + i * per, per };
+    }
+    if (lk != nullptr && cpuHas(lk->required)) {
+        sm4CmacUpdateStreamsWith(*lk, streams, kBenchCmacStreams);
+    }
+    else {
+        for (size_t i = 0; i < kBenchCmacStreams; i++) {
+            macs[i].update(streams[i].data, streams[i].len);
+        }
+    }
+    for (size_t i = 0; i < kBenchCmacStreams; i++) {
+        macs[i].finalize(out + 16 * i);
+    }
+}
+
+// 新模式在此追加一项即可参与扫描和校验
+static const BenchMode kBenchModes[] = {
+    { "ecb", benchEcb, 0 },
+    { "ctr", benchCtr, 0 },
+    { "cbcdec", benchCbcDec, 0 },
+    { "gmac", benchGmac, 16 },
+    { "cmac", benchCmac, 16 },
+    { "cmac16", benchCmacStreams, 16 * kBenchCmacStreams },
+};
+
+// -------------------------- 计时工具 --------------------------
+
+static void pinToCpu(int cpu) {
+#if defined(_WIN32)
+    if (SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) == 0) {
+        fprintf(stderr, "警告: 无法绑定到CPU %d\n", cpu);
+    }
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        fprintf(stderr, "警告: 无法绑定到CPU %d\n", cpu);
+    }
+#endif
+}
+
+struct BenchResult {
+    string kernel;
+    string mode;
+    size_t bytes;
+    double cyclesPerByte;
+    double gbps;
+    bool ok;
+};
+
+// 重复运行直到累计时间达到minTime (至少3次)，取单次耗时的中位数
+static void measure(const BenchMode& mode, const Sm4Kernel& kernel, const uint32_t rk[32],
+    const uint8_t* in, uint8_t* out, size_t len, double minTime, double& cycles, double& seconds) {
+    mode.run(kernel, rk, in, out, len);  // 预热
+
+    vector<double> cyc, sec;
+    double total = 0;
+    while (total < minTime || cyc.size() < 3) {
+        auto t0 = chrono::steady_clock::now();
+        uint64_t c0 = __rdtsc();
+        mode.run(kernel, rk, in, out, len);
+        uint64_t c1 = __rdtsc();
+        auto t1 = chrono::steady_clock::now();
+        double s = chrono::duration<double>(t1 - t0).count();
+        cyc.push_back((double)(c1 - c0));
+        sec.push_back(s);
+        total += s;
+    }
+    sort(cyc.begin(), cyc.end());
+    sort(sec.begin(), sec.end());
+    cycles = cyc[cyc.size() / 2];
+    seconds = sec[sec.size() / 2];
+}
+
+// -------------------------- 命令行与输出 --------------------------
+
+static bool inList(const string& list, const char* name) {
+    if (list.empty()) {
+        return true;
+    }
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == string::npos) {
+            end = list.size();
+        }
+        if (list.compare(start, end - start, name) == 0) {
+            return true;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+static void printResults(FILE* f, const string& format, const vector<BenchResult>& results, int failures) {
+    if (format == "json") {
+        fprintf(f, "{\n  \"selected_kernel\": \"%s\",\n  \"failures\": %d,\n  \"results\": [\n", sm4_kernel_name(), failures);
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult& r = results[i];
+            fprintf(f, "    {\"kernel\": \"%s\", \"mode\": \"%s\", \"bytes\": %zu, \"cycles_per_byte\": %.4f, \"gbps\": %.4f, \"ok\": %s}%s\n",
+                r.kernel.c_str(), r.mode.c_str(), r.bytes, r.cyclesPerByte, r.gbps, r.ok ? "true" : "false",
+                i + 1 < results.size() ? "," : "");
+        }
+        fprintf(f, "  ]\n}\n");
+    }
+    else if (format == "csv") {
+        fprintf(f, "kernel,mode,bytes,cycles_per_byte,gbps,ok\n");
+        for (const BenchResult& r : results) {
+            fprintf(f, "%s,%s,%zu,%.4f,%.4f,%d\n", r.kernel.c_str(), r.mode.c_str(), r.bytes, r.cyclesPerByte, r.gbps, r.ok ? 1 : 0);
+        }
+    }
+    else {
+        // 模式列宽取注册表中最长的名字，新增模式不会让各行错位
+        int modeWidth = (int)strlen("mode");
+        for (const BenchMode& mode : kBenchModes) {
+            modeWidth = max(modeWidth, (int)strlen(mode.name));
+        }
+        fprintf(f, "自动选择的内核: %s\n", sm4_kernel_name());
+        fprintf(f, "%-16s %-*s %10s %12s %10s  %s\n", "kernel", modeWidth, "mode", "bytes", "cycles/byte", "GB/s", "check");
+        for (const BenchResult& r : results) {
+            fprintf(f, "%-16s %-*s %10zu %12.2f %10.3f  %s\n", r.kernel.c_str(), modeWidth, r.mode.c_str(), r.bytes,
+                r.cyclesPerByte, r.gbps, r.ok ? "ok" : "MISMATCH");
+        }
+        fprintf(f, "不一致: %d\n", failures);
+    }
+}
+
+int main(int argc, char** argv) {
+    string format = "text", output, kernels, modes;
+    int cpu = 0;
+    size_t maxSize = (size_t)64 << 20;
+    double minTime = 0.05;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (val == nullptr) {
+            fprintf(stderr, "参数 %s 缺少取值\n", arg.c_str());
+            return 2;
+        }
+        if (arg == "--format") format = val;
+        else if (arg == "--output") output = val;
+        else if (arg == "--cpu") cpu = atoi(val);
+        else if (arg == "--kernels") kernels = val;
+        else if (arg == "--modes") modes = val;
+        else if (arg == "--max-size") maxSize = (size_t)strtoull(val, nullptr, 10);
+        else if (arg == "--min-time") minTime = atof(val);
+        else {
+            fprintf(stderr, "未知参数 %s\n", arg.c_str());
+            return 2;
+        }
+        i++;
+    }
+    maxSize = max<size_t>(16, maxSize / 16 * 16);
+
+    pinToCpu(cpu);
+
+    uint8_t key[16] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF,
+                      0xFE, 0xDC, 0xBA, 0x98, 0x76, 0x54, 0x32, 0x10 };
+    uint32_t rk[32];
+    keyExpansionBasic(key, rk);
+
+    vector<uint8_t> in(maxSize), out(maxSize), ref(maxSize);
+    for (size_t i = 0; i < maxSize; i++) {
+        in[i] = (uint8_t)(i * 131 + (i >> 8));
+    }
+
+    // 16 B, 64 B, ... 按4倍递增到maxSize
+    vector<size_t> sizes;
+    for (size_t s = 16; s <= maxSize; s *= 4) {
+        sizes.push_back(s);
+    }
+    if (sizes.back() != maxSize) {
+        sizes.push_back(maxSize);
+    }
+
+    // MAC模式的标签按长度依次存放在ref中
+    size_t maxTag = 0;
+    for (const BenchMode& mode : kBenchModes) {
+        maxTag = max(maxTag, mode.tagBytes);
+    }
+    out.resize(max(maxSize, maxTag));
+    ref.resize(max(maxSize, sizes.size() * maxTag));
+
+    vector<BenchResult> results;
+    int failures = 0;
+    for (const BenchMode& mode : kBenchModes) {
+        if (!inList(modes, mode.name)) {
+            continue;
+        }
+        // 加解密模式的输出前缀只取决于输入前缀，基础版本只需在最大长度上算一次；
+        // MAC的标签取决于整条消息，按每个长度分别算好
+        const Sm4Kernel& basic = *sm4FindKernel("basic");
+        if (mode.tagBytes == 0) {
+            mode.run(basic, rk, in.data(), ref.data(), maxSize);
+        }
+        else {
+            for (size_t i = 0; i < sizes.size(); i++) {
+                mode.run(basic, rk, in.data(), ref.data() + i * mode.tagBytes, sizes[i]);
+            }
+        }
+
+        for (const Sm4Kernel& k : kSm4Kernels) {
+            if (!inList(kernels, k.name)) {
+                continue;
+            }
+            if (!cpuHas(k.required)) {
+                fprintf(stderr, "跳过 %s: CPU不支持\n", k.name);
+                continue;
+            }
+            for (size_t i = 0; i < sizes.size(); i++) {
+                size_t len = sizes[i];
+                double cycles, seconds;
+                measure(mode, k, rk, in.data(), out.data(), len, minTime, cycles, seconds);
+                bool ok = (mode.tagBytes == 0) ? memcmp(out.data(), ref.data(), len) == 0
+                    : memcmp(out.data(), ref.data() + i * mode.tagBytes, mode.tagBytes) == 0;
+                if (!ok) {
+                    failures++;
+                }
+                results.push_back({ k.name, mode.name, len, cycles / len, len / seconds / 1e9, ok });
+            }
+        }
+    }
+
+    FILE* f = stdout;
+    if (!output.empty()) {
+        f = fopen(output.c_str(), "w");
+        if (f == nullptr) {
+            fprintf(stderr, "无法写入 %s\n", output.c_str());
+            return 2;
+        }
+    }
+    printResults(f, format, results, failures);
+    if (f != stdout) {
+        fclose(f);
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "有 %d 项结果与sm4EncryptBasic不一致\n", failures);
+        return 1;
+    }
+    return 0;
+}
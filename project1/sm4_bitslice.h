@@ -0,0 +1,306 @@
+#pragma once
+// 位切片 (bitslice) SM4：S盒用布尔电路计算，全程没有依赖密钥或数据的查表与分支，
+// 执行时间与输入无关，可在禁止T-table的多租户环境中使用
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <immintrin.h>
+
+#include "cpu_features.h"
+
+#if defined(_MSC_VER)
+#define BS_INLINE __forceinline
+#else
+#define BS_INLINE inline __attribute__((always_inline))
+#endif
+
+// -------------------------- 切片类型 --------------------------
+
+// 一个切片保存所有并行分组的同一比特：uint64_t为64个分组，Bs128/Bs256/Bs512分别为128/256/512个分组。
+// 电路只用到 ^ & ~ 三种运算；模板函数强制内联进带CPU_TARGET的内核，由内核决定生成哪种指令
+#if defined(_MSC_VER)
+struct Bs128 { __m128i v; };
+struct Bs256 { __m256i v; };
+struct Bs512 { __m512i v; };
+BS_INLINE Bs128 operator^(Bs128 a, Bs128 b) { return { _mm_xor_si128(a.v, b.v) }; }
+BS_INLINE Bs128 operator&(Bs128 a, Bs128 b) { return { _mm_and_si128(a.v, b.v) }; }
+BS_INLINE Bs128 operator~(Bs128 a) { return { _mm_xor_si128(a.v, _mm_set1_epi32(-1)) }; }
+BS_INLINE Bs256 operator^(Bs256 a, Bs256 b) { return { _mm256_xor_si256(a.v, b.v) }; }
+BS_INLINE Bs256 operator&(Bs256 a, Bs256 b) { return { _mm256_and_si256(a.v, b.v) }; }
+BS_INLINE Bs256 operator~(Bs256 a) { return { _mm256_xor_si256(a.v, _mm256_set1_epi32(-1)) }; }
+BS_INLINE Bs512 operator^(Bs512 a, Bs512 b) { return { _mm512_xor_si512(a.v, b.v) }; }
+BS_INLINE Bs512 operator&(Bs512 a, Bs512 b) { return { _mm512_and_si512(a.v, b.v) }; }
+BS_INLINE Bs512 operator~(Bs512 a) { return { _mm512_xor_si512(a.v, _mm512_set1_epi32(-1)) }; }
+#else
+// GCC/Clang向量扩展：运算符由编译器按所在函数的目标指令集生成
+typedef uint64_t Bs128 __attribute__((vector_size(16)));
+typedef uint64_t Bs256 __attribute__((vector_size(32)));
+typedef uint64_t Bs512 __attribute__((vector_size(64)));
+#endif
+
+// 把64位掩码复制到切片的每个64位通道
+#if defined(_MSC_VER)
+BS_INLINE void bsFill(uint64_t& r, uint64_t m) { r = m; }
+BS_INLINE void bsFill(Bs128& r, uint64_t m) { r.v = _mm_set1_epi64x((long long)m); }
+BS_INLINE void bsFill(Bs256& r, uint64_t m) { r.v = _mm256_set1_epi64x((long long)m); }
+BS_INLINE void bsFill(Bs512& r, uint64_t m) { r.v = _mm512_set1_epi64((long long)m); }
+#else
+template<typename V>
+BS_INLINE void bsFill(V& r, uint64_t m) {
+    V zero = {};
+    r = zero ^ m;
+}
+#endif
+
+// -------------------------- S盒布尔电路 --------------------------
+
+// GF(2^4)乘法，多项式基 z^4 + z + 1，比特0为常数项
+template<typename V>
+BS_INLINE void bsMulGF16(const V a[4], const V b[4], V r[4]) {
+    V c0 = a[0] & b[0];
+    V c1 = (a[0] & b[1]) ^ (a[1] & b[0]);
+    V c2 = (a[0] & b[2]) ^ (a[1] & b[1]) ^ (a[2] & b[0]);
+    V c3 = (a[0] & b[3]) ^ (a[1] & b[2]) ^ (a[2] & b[1]) ^ (a[3] & b[0]);
+    V c4 = (a[1] & b[3]) ^ (a[2] & b[2]) ^ (a[3] & b[1]);
+    V c5 = (a[2] & b[3]) ^ (a[3] & b[2]);
+    V c6 = a[3] & b[3];
+    // z^4 = z + 1, z^5 = z^2 + z, z^6 = z^3 + z^2
+    r[0] = c0 ^ c4;
+    r[1] = c1 ^ c4 ^ c5;
+    r[2] = c2 ^ c5 ^ c6;
+    r[3] = c3 ^ c6;
+}
+
+// SM4 S盒：S(x) = A·inv(A·x + c) + c。
+// 求逆放到复合域 GF((2^4)^2) 中完成：GF(2^8) = GF(2^4)[y]/(y^2 + y + 9)，
+// 元素 a1·y + a0 的逆为 (a0 + a1)·d^-1 + a1·d^-1·y，其中 d = 9·a1^2 + a1·a0 + a0^2，
+// 输入/输出两层GF(2)线性网络由基变换 (SM4域 -> 复合域，y^8的像为0x8E) 与A、c合并而来，
+// 按比特0为最低位排列，常数c体现为取反
+template<typename V>
+BS_INLINE void sm4SboxBitslice(V x[8]) {
+    V a0[4], a1[4];
+    a0[0] = ~(x[4] ^ x[5] ^ x[6] ^ x[7]);
+    a0[1] = ~(x[1] ^ x[4] ^ x[5] ^ x[6]);
+    a0[2] = ~(x[1] ^ x[2] ^ x[4] ^ x[6] ^ x[7]);
+    a0[3] = ~(x[3] ^ x[4]);
+    a1[0] = x[0] ^ x[1] ^ x[4] ^ x[7];
+    a1[1] = ~x[6];
+    a1[2] = x[2] ^ x[6] ^ x[7];
+    a1[3] = ~(x[0] ^ x[1] ^ x[2] ^ x[3] ^ x[4] ^ x[5] ^ x[6]);
+
+    // d = 9·a1^2 + a1·a0 + a0^2 (平方与乘常数都是线性的)
+    V d[4];
+    bsMulGF16(a1, a0, d);
+    d[0] = d[0] ^ a1[0] ^ a0[0] ^ a0[2];
+    d[1] = d[1] ^ a1[1] ^ a1[3] ^ a0[2];
+    d[2] = d[2] ^ a1[3] ^ a0[1] ^ a0[3];
+    d[3] = d[3] ^ a1[0] ^ a1[2] ^ a0[3];
+
+    // d^-1：GF(2^4)求逆按各输出比特的代数正规型直接展开，10次AND
+    V d01 = d[0] & d[1], d02 = d[0] & d[2], d12 = d[1] & d[2];
+    V d03 = d[0] & d[3], d13 = d[1] & d[3], d23 = d[2] & d[3];
+    V d012 = d01 & d[2], d123 = d12 & d[3], d013 = d01 & d[3], d023 = d02 & d[3];
+    V di[4];
+    di[0] = d[0] ^ d[1] ^ d[2] ^ d[3] ^ d02 ^ d12 ^ d012 ^ d123;
+    di[1] = d01 ^ d02 ^ d12 ^ d[3] ^ d13 ^ d013;
+    di[2] = d01 ^ d[2] ^ d02 ^ d[3] ^ d03 ^ d023;
+    di[3] = d[1] ^ d[2] ^ d[3] ^ d03 ^ d13 ^ d23 ^ d123;
+
+    V s[4], v[8];
+    for (int i = 0; i < 4; i++) {
+        s[i] = a0[i] ^ a1[i];
+    }
+    bsMulGF16(s, di, v);
+    bsMulGF16(a1, di, v + 4);
+
+    x[0] = ~(v[0] ^ v[1] ^ v[4] ^ v[5]);
+    x[1] = ~(v[0] ^ v[2] ^ v[5] ^ v[6]);
+    x[2] = v[2] ^ v[4];
+    x[3] = v[0] ^ v[2] ^ v[4] ^ v[5] ^ v[7];
+    x[4] = ~(v[1] ^ v[3] ^ v[7]);
+    x[5] = v[1] ^ v[3] ^ v[5];
+    x[6] = ~(v[0] ^ v[1] ^ v[2]);
+    x[7] = ~(v[0] ^ v[3] ^ v[5]);
+}
+
+// 单个32位字的S盒 (密钥扩展用)：4个字节分别放在切片的低4个比特通道，同样不查表
+inline uint32_t sm4SboxWordBitslice(uint32_t w) {
+    uint64_t x[8];
+    for (int b = 0; b < 8; b++) {
+        x[b] = 0;
+        for (int k = 0; k < 4; k++) {
+            x[b] |= (uint64_t)((w >> (8 * k + b)) & 1) << k;
+        }
+    }
+    sm4SboxBitslice(x);
+    uint32_t r = 0;
+    for (int b = 0; b < 8; b++) {
+        for (int k = 0; k < 4; k++) {
+            r |= (uint32_t)((x[b] >> k) & 1) << (8 * k + b);
+        }
+    }
+    return r;
+}
+
+// -------------------------- 轮函数 --------------------------
+
+// 一轮：x0 ^= L(S(x1 ^ x2 ^ x3 ^ rk))。每个字用32个切片表示 (下标即比特位置)，
+// 轮密钥比特展开成全0/全1掩码；L中的循环左移只是切片下标的重排，不产生运算
+template<typename V>
+BS_INLINE void sm4RoundBitslice(V x0[32], const V x1[32], const V x2[32], const V x3[32], uint32_t rk) {
+    V t[32];
+    for (int b = 0; b < 32; b++) {
+        V k;
+        bsFill(k, 0 - (uint64_t)((rk >> b) & 1));
+        t[b] = x1[b] ^ x2[b] ^ x3[b] ^ k;
+    }
+    for (int i = 0; i < 32; i += 8) {
+        sm4SboxBitslice(t + i);
+    }
+    for (int b = 0; b < 32; b++) {
+        x0[b] = x0[b] ^ t[b] ^ t[(b - 2) & 31] ^ t[(b - 10) & 31] ^ t[(b - 18) & 31] ^ t[(b - 24) & 31];
+    }
+}
+
+// -------------------------- 转置 --------------------------
+
+// 64x64比特矩阵原地转置 (a[0]为第一行，最高位为第一列)：
+// 依次交换32x32、16x16 ... 1x1的非对角子块，共6级
+template<int J>
+BS_INLINE void bsTransposeStage(uint64_t a[64], uint64_t m) {
+    for (int k0 = 0; k0 < 64; k0 += 2 * J) {
+        for (int k = k0; k < k0 + J; k++) {
+            uint64_t t = (a[k] ^ (a[k + J] >> J)) & m;
+            a[k] ^= t;
+            a[k + J] ^= t << J;
+        }
+    }
+}
+
+inline void bsTranspose64(uint64_t a[64]) {
+    bsTransposeStage<32>(a, 0x00000000FFFFFFFFull);
+    bsTransposeStage<16>(a, 0x0000FFFF0000FFFFull);
+    bsTransposeStage<8>(a, 0x00FF00FF00FF00FFull);
+    bsTransposeStage<4>(a, 0x0F0F0F0F0F0F0F0Full);
+    bsTransposeStage<2>(a, 0x3333333333333333ull);
+    bsTransposeStage<1>(a, 0x5555555555555555ull);
+}
+
+inline uint64_t load64BE(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+inline void store64BE(uint8_t* p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+// 一批 64·(sizeof(V)/8) 个分组的加密。每64个分组为一组：分组的两个64位大端半部作为行，
+// 转置后第r行是所有分组的第 (63 - r) 比特，即一个切片；第j组放在切片的第j个64位通道
+template<typename V>
+BS_INLINE void sm4EncryptBitsliceBatch(const uint32_t rk[32], const uint8_t* in, uint8_t* out) {
+    const size_t kLanes = sizeof(V) / 8;
+    uint64_t lanes[4][32][kLanes];
+    uint64_t rows[2][64];
+
+    for (size_t j = 0; j < kLanes; j++) {
+        for (int h = 0; h < 2; h++) {
+            for (int i = 0; i < 64; i++) {
+                rows[h][i] = load64BE(in + 16 * (64 * j + i) + 8 * h);
+            }
+            bsTranspose64(rows[h]);
+        }
+        // 字w的比特b：偶数字在行的高32位，奇数字在低32位
+        for (int w = 0; w < 4; w++) {
+            for (int b = 0; b < 32; b++) {
+                lanes[w][b][j] = rows[w >> 1][((w & 1) ? 63 : 31) - b];
+            }
+        }
+    }
+
+    V X[4][32];
+    memcpy(X, lanes, sizeof(X));
+
+    for (int i = 0; i < 32; i += 4) {
+        sm4RoundBitslice(X[0], X[1], X[2], X[3], rk[i]);
+        sm4RoundBitslice(X[1], X[2], X[3], X[0], rk[i + 1]);
+        sm4RoundBitslice(X[2], X[3], X[0], X[1], rk[i + 2]);
+        sm4RoundBitslice(X[3], X[0], X[1], X[2], rk[i + 3]);
+    }
+
+    // 反序输出 (X35, X34, X33, X32)
+    memcpy(lanes, X, sizeof(X));
+    for (size_t j = 0; j < kLanes; j++) {
+        for (int w = 0; w < 4; w++) {
+            for (int b = 0; b < 32; b++) {
+                rows[w >> 1][((w & 1) ? 63 : 31) - b] = lanes[3 - w][b][j];
+            }
+        }
+        for (int h = 0; h < 2; h++) {
+            bsTranspose64(rows[h]);
+            for (int i = 0; i < 64; i++) {
+                store64BE(out + 16 * (64 * j + i) + 8 * h, rows[h][i]);
+            }
+        }
+    }
+}
+
+// -------------------------- 批量接口 --------------------------
+
+// 64路 (通用寄存器)：不足64块的尾部补齐后仍走位切片电路
+inline void sm4EncryptBlocksBitslice64(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    while (nblocks >= 64) {
+        sm4EncryptBitsliceBatch<uint64_t>(rk, in, out);
+        in += 64 * 16;
+        out += 64 * 16;
+        nblocks -= 64;
+    }
+    if (nblocks > 0) {
+        uint8_t buf[64 * 16] = { 0 };
+        memcpy(buf, in, nblocks * 16);
+        sm4EncryptBitsliceBatch<uint64_t>(rk, buf, buf);
+        memcpy(out, buf, nblocks * 16);
+    }
+}
+
+// 128路 (SSE2，x86-64基线指令集)
+inline void sm4EncryptBlocksBitslice128(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    while (nblocks >= 128) {
+        sm4EncryptBitsliceBatch<Bs128>(rk, in, out);
+        in += 128 * 16;
+        out += 128 * 16;
+        nblocks -= 128;
+    }
+    sm4EncryptBlocksBitslice64(rk, in, out, nblocks);
+}
+
+// 256路 (AVX2)
+CPU_TARGET("avx2")
+inline void sm4EncryptBlocksBitslice256(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    while (nblocks >= 256) {
+        sm4EncryptBitsliceBatch<Bs256>(rk, in, out);
+        in += 256 * 16;
+        out += 256 * 16;
+        nblocks -= 256;
+    }
+    sm4EncryptBlocksBitslice128(rk, in, out, nblocks);
+}
+
+// 512路 (AVX-512)
+CPU_TARGET("avx2,avx512f")
+inline void sm4EncryptBlocksBitslice512(const uint32_t rk[32], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    while (nblocks >= 512) {
+        sm4EncryptBitsliceBatch<Bs512>(rk, in, out);
+        in += 512 * 16;
+        out += 512 * 16;
+        nblocks -= 512;
+    }
+    sm4EncryptBlocksBitslice256(rk, in, out, nblocks);
+}
@@ -0,0 +1,121 @@
+#pragma once
+// SM4-CBC：
+// 解密时各分组互不依赖 (P_i = D(C_i) ^ C_{i-1})，整批密文交给分派选定的批量内核；
+// 加密在单个流内是串行的，改为把多个独立的流 (各自的密钥、IV和缓冲区) 放进多路内核的不同通道并行推进
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "sm4.h"
+#include "sm4_key.h"
+#include "sm4_lanes.h"
+
+// -------------------------- 解密 --------------------------
+
+// 用指定内核和解密轮密钥做CBC解密。iv返回时为最后一个密文分组，可直接用于下一段数据。
+// in与out可以相同 (原地解密)，但不能部分重叠。
+// 每批取内核的首选分组数：一般为64 (16路GFNI内核迭代4次)，位切片内核为128/256/512，宽电路才能整批运行
+inline void sm4CbcDecryptWith(Sm4BlocksFunc kernel, const uint32_t drk[32], uint8_t iv[16],
+    const uint8_t* in, uint8_t* out, size_t nblocks) {
+    const size_t batch = sm4KernelBatch(kernel);
+    uint8_t buf[kSm4MaxBatch * 16];
+    const size_t used = 16 * std::min(nblocks, batch);
+    while (nblocks > 0) {
+        size_t n = std::min(nblocks, batch);
+        kernel(drk, in, buf, n);
+
+        uint8_t next[16];
+        memcpy(next, in + 16 * (n - 1), 16);
+        // 从后往前异或：原地解密时写out[i]之前，C_{i-1}还没有被覆盖
+        for (size_t i = n - 1; i > 0; i--) {
+            xorBlock16(out + 16 * i, buf + 16 * i, in + 16 * (i - 1));
+        }
+        xorBlock16(out, buf, iv);
+        memcpy(iv, next, 16);
+
+        in += 16 * n;
+        out += 16 * n;
+        nblocks -= n;
+    }
+    // buf中是D(C_i)，与公开的密文异或即得明文，返回前清除
+    sm4Wipe(buf, used);
+}
+
+inline void sm4CbcDecrypt(const Sm4Key& key, uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    sm4CbcDecryptWith(g_sm4Kernel->encrypt_blocks, key.dec, iv, in, out, nblocks);
+}
+
+// -------------------------- 多流加密 --------------------------
+
+// 一个独立的CBC加密流。iv返回时为最后一个密文分组；in与out可以相同
+struct Sm4CbcStream {
+    const Sm4Key* key;
+    uint8_t iv[16];
+    const uint8_t* in;
+    uint8_t* out;
+    size_t nblocks;
+};
+
+// 每个通道依次领取一个流，逐块推进：C_j = E(P_j ^ C_{j-1})，
+// 各通道每次各加密一个分组，流结束后通道立即领取下一个流，长短不一的流不会让其他通道空等
+inline void sm4CbcEncryptStreamsWith(const Sm4LaneKernel& lk, Sm4CbcStream* streams, size_t count) {
+    const size_t W = lk.lanes;
+    alignas(64) uint32_t rkLanes[32 * kSm4MaxLanes];
+    alignas(64) uint8_t buf[kSm4MaxLanes * 16] = { 0 };
+    Sm4CbcStream* lane[kSm4MaxLanes] = { nullptr };
+    size_t pos[kSm4MaxLanes] = { 0 };
+    size_t next = 0;
+    memset(rkLanes, 0, sizeof(rkLanes));
+
+    for (;;) {
+        bool active = false;
+        for (size_t b = 0; b < W; b++) {
+            if (lane[b] == nullptr) {
+                while (next < count && streams[next].nblocks == 0) {
+                    next++;
+                }
+                if (next < count) {
+                    lane[b] = &streams[next++];
+                    pos[b] = 0;
+                    sm4SetLaneKey(rkLanes, W, b, lane[b]->key->enc);
+                }
+            }
+            if (lane[b] != nullptr) {
+                active = true;
+                xorBlock16(buf + 16 * b, lane[b]->in + 16 * pos[b], lane[b]->iv);
+            }
+        }
+        if (!active) {
+            break;
+        }
+
+        lk.encrypt_lanes(rkLanes, buf, buf);
+
+        for (size_t b = 0; b < W; b++) {
+            Sm4CbcStream* s = lane[b];
+            if (s == nullptr) {
+                continue;
+            }
+            memcpy(s->out + 16 * pos[b], buf + 16 * b, 16);
+            memcpy(s->iv, buf + 16 * b, 16);
+            if (++pos[b] == s->nblocks) {
+                lane[b] = nullptr;
+            }
+        }
+    }
+    sm4Wipe(rkLanes, sizeof(rkLanes));
+}
+
+inline void sm4CbcEncryptStreams(Sm4CbcStream* streams, size_t count) {
+    sm4CbcEncryptStreamsWith(*g_sm4LaneKernel, streams, count);
+}
+
+// 单流加密：只占用一个通道，但每个分组仍要跑一遍完整的W路内核 (gfni-avx512为16路)，
+// 吞吐量约为多流的1/W。有多个独立的流时应交给sm4CbcEncryptStreams一起处理
+inline void sm4CbcEncrypt(const Sm4Key& key, uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t nblocks) {
+    Sm4CbcStream s = { &key, {}, in, out, nblocks };
+    memcpy(s.iv, iv, 16);
+    sm4CbcEncryptStreams(&s, 1);
+    memcpy(iv, s.iv, 16);
+}
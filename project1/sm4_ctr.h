@@ -0,0 +1,207 @@
+#pragma once
+// SM4-CTR流式加解密：update可以接受任意长度的数据片段。
+// 计数器分组在SIMD寄存器中成批生成 (加法 + pshufb转大端)，整批交给分派选定的批量内核，
+// 再与输入做宽向量异或；片段不在分组边界结束时，最后一个分组剩余的密钥流留给下一次update使用
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "sm4.h"
+#include "sm4_key.h"
+
+// 计数器递增方式
+enum Sm4CtrIncrement {
+    SM4_CTR_INC128,     // 整个128位分组作为大端整数递增
+    SM4_CTR_INC32,      // 只有最低32位递增 (模2^32)，高96位不变，与GCM相同
+};
+
+// -------------------------- 计数器生成 --------------------------
+
+// 从 (hi, lo) 开始生成n个连续的计数器分组 (大端)。
+// INC128时调用者保证lo在这n个分组内不会进位到hi
+CPU_TARGET("ssse3")
+inline void sm4CtrFillSSSE3(uint8_t* out, size_t n, uint64_t hi, uint64_t lo, Sm4CtrIncrement inc) {
+    const __m128i bswap128 = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    // 寄存器中按小端保存，低64位为lo；INC32用32位加法，进位自然在第32位截断
+    __m128i c = _mm_set_epi64x((long long)hi, (long long)lo);
+    __m128i step1 = (inc == SM4_CTR_INC32) ? _mm_set_epi32(0, 0, 0, 1) : _mm_set_epi64x(0, 1);
+    __m128i step4 = (inc == SM4_CTR_INC32) ? _mm_set_epi32(0, 0, 0, 4) : _mm_set_epi64x(0, 4);
+    __m128i c0 = c;
+    __m128i c1 = (inc == SM4_CTR_INC32) ? _mm_add_epi32(c0, step1) : _mm_add_epi64(c0, step1);
+    __m128i c2 = (inc == SM4_CTR_INC32) ? _mm_add_epi32(c1, step1) : _mm_add_epi64(c1, step1);
+    __m128i c3 = (inc == SM4_CTR_INC32) ? _mm_add_epi32(c2, step1) : _mm_add_epi64(c2, step1);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_si128((__m128i*)(out + 16 * i), _mm_shuffle_epi8(c0, bswap128));
+        _mm_storeu_si128((__m128i*)(out + 16 * i + 16), _mm_shuffle_epi8(c1, bswap128));
+        _mm_storeu_si128((__m128i*)(out + 16 * i + 32), _mm_shuffle_epi8(c2, bswap128));
+        _mm_storeu_si128((__m128i*)(out + 16 * i + 48), _mm_shuffle_epi8(c3, bswap128));
+        if (inc == SM4_CTR_INC32) {
+            c0 = _mm_add_epi32(c0, step4);
+            c1 = _mm_add_epi32(c1, step4);
+            c2 = _mm_add_epi32(c2, step4);
+            c3 = _mm_add_epi32(c3, step4);
+        }
+        else {
+            c0 = _mm_add_epi64(c0, step4);
+            c1 = _mm_add_epi64(c1, step4);
+            c2 = _mm_add_epi64(c2, step4);
+            c3 = _mm_add_epi64(c3, step4);
+        }
+    }
+    for (; i < n; i++) {
+        _mm_storeu_si128((__m128i*)(out + 16 * i), _mm_shuffle_epi8(c0, bswap128));
+        c0 = (inc == SM4_CTR_INC32) ? _mm_add_epi32(c0, step1) : _mm_add_epi64(c0, step1);
+    }
+}
+
+// 标量版本，允许跨越64位进位
+inline void sm4CtrFillScalar(uint8_t* out, size_t n, uint64_t hi, uint64_t lo, Sm4CtrIncrement inc) {
+    for (size_t i = 0; i < n; i++) {
+        store32BE(out + 16 * i, (uint32_t)(hi >> 32));
+        store32BE(out + 16 * i + 4, (uint32_t)hi);
+        store32BE(out + 16 * i + 8, (uint32_t)(lo >> 32));
+        store32BE(out + 16 * i + 12, (uint32_t)lo);
+        if (inc == SM4_CTR_INC32) {
+            lo = (lo & 0xFFFFFFFF00000000ull) | (uint32_t)(lo + 1);
+        }
+        else if (++lo == 0) {
+            hi++;
+        }
+    }
+}
+
+// 生成n个计数器分组并把 (hi, lo) 前移n
+inline void sm4CtrFill(uint8_t* out, size_t n, uint64_t& hi, uint64_t& lo, Sm4CtrIncrement inc) {
+    static const bool ssse3 = cpuHas(CPU_SSSE3);
+    if (inc == SM4_CTR_INC32) {
+        if (ssse3) {
+            sm4CtrFillSSSE3(out, n, hi, lo, inc);
+        }
+        else {
+            sm4CtrFillScalar(out, n, hi, lo, inc);
+        }
+        lo = (lo & 0xFFFFFFFF00000000ull) | (uint32_t)(lo + n);
+        return;
+    }
+
+    // 64位进位极少出现，只在这一批会跨过进位时走标量版本
+    if (ssse3 && lo <= UINT64_MAX - n) {
+        sm4CtrFillSSSE3(out, n, hi, lo, inc);
+    }
+    else {
+        sm4CtrFillScalar(out, n, hi, lo, inc);
+    }
+    if (lo + n < lo) {
+        hi++;
+    }
+    lo += n;
+}
+
+// 计数器前移n个分组，用于从消息中间开始加解密 (例如多线程按段处理)
+inline void sm4CounterAdd(uint8_t ctr[16], uint64_t n, Sm4CtrIncrement inc) {
+    uint64_t hi = ((uint64_t)load32BE(ctr) << 32) | load32BE(ctr + 4);
+    uint64_t lo = ((uint64_t)load32BE(ctr + 8) << 32) | load32BE(ctr + 12);
+    if (inc == SM4_CTR_INC32) {
+        lo = (lo & 0xFFFFFFFF00000000ull) | (uint32_t)(lo + n);
+    }
+    else {
+        if (lo + n < lo) {
+            hi++;
+        }
+        lo += n;
+    }
+    store32BE(ctr, (uint32_t)(hi >> 32));
+    store32BE(ctr + 4, (uint32_t)hi);
+    store32BE(ctr + 8, (uint32_t)(lo >> 32));
+    store32BE(ctr + 12, (uint32_t)lo);
+}
+
+// -------------------------- 流式CTR --------------------------
+
+class Sm4Ctr {
+public:
+    // kernel为空时使用分派选定的批量内核
+    Sm4Ctr(const uint32_t rk[32], const uint8_t iv[16], Sm4CtrIncrement inc = SM4_CTR_INC128, Sm4BlocksFunc kernel = nullptr)
+        : inc_(inc), kernel_(kernel != nullptr ? kernel : g_sm4Kernel->encrypt_blocks), batch_(sm4KernelBatch(kernel_)) {
+        memcpy(rk_, rk, sizeof(rk_));
+        reset(iv);
+    }
+
+    Sm4Ctr(const Sm4Key& key, const uint8_t iv[16], Sm4CtrIncrement inc = SM4_CTR_INC128, Sm4BlocksFunc kernel = nullptr)
+        : Sm4Ctr(key.enc, iv, inc, kernel) {
+    }
+
+    ~Sm4Ctr() {
+        sm4Wipe(rk_, sizeof(rk_));
+        sm4Wipe(ks_, sizeof(ks_));
+    }
+
+    Sm4Ctr(const Sm4Ctr&) = delete;
+    Sm4Ctr& operator=(const Sm4Ctr&) = delete;
+
+    // 重新从iv开始，丢弃缓冲区中的密钥流
+    void reset(const uint8_t iv[16]) {
+        hi_ = ((uint64_t)load32BE(iv) << 32) | load32BE(iv + 4);
+        lo_ = ((uint64_t)load32BE(iv + 8) << 32) | load32BE(iv + 12);
+        ksPos_ = ksLen_ = 0;
+    }
+
+    // 加密或解密len字节，in与out可以相同。连续多次调用的结果与一次处理拼接后的数据相同
+    void update(const uint8_t* in, uint8_t* out, size_t len) {
+        // 先用完上一次剩下的密钥流
+        size_t n = std::min(len, ksLen_ - ksPos_);
+        xorBytes(out, in, ks_ + ksPos_, n);
+        ksPos_ += n;
+        in += n;
+        out += n;
+        len -= n;
+
+        // 整批：计数器生成、加密、异或，批量取内核的首选分组数 (位切片内核最多512个)
+        alignas(64) uint8_t ctr[kSm4MaxBatch * 16];
+        const size_t batchBytes = batch_ * 16;
+        size_t used = 0;
+        while (len >= batchBytes) {
+            sm4CtrFill(ctr, batch_, hi_, lo_, inc_);
+            kernel_(rk_, ctr, ctr, batch_);
+            xorBytes(out, in, ctr, batchBytes);
+            in += batchBytes;
+            out += batchBytes;
+            len -= batchBytes;
+            used = batchBytes;
+        }
+
+        // 不足一批的部分只生成需要的分组数，最后一个分组没用完的字节留给下一次
+        if (len > 0) {
+            size_t blocks = (len + 15) / 16;
+            sm4CtrFill(ctr, blocks, hi_, lo_, inc_);
+            kernel_(rk_, ctr, ctr, blocks);
+            xorBytes(out, in, ctr, len);
+            memcpy(ks_, ctr + 16 * (blocks - 1), 16);
+            ksPos_ = len - 16 * (blocks - 1);
+            ksLen_ = 16;
+            used = std::max(used, blocks * 16);
+        }
+        // 栈上的密钥流不留到函数返回之后
+        sm4Wipe(ctr, used);
+    }
+
+    // 下一个尚未使用的计数器值 (不含缓冲区中剩余的密钥流)
+    void counter(uint8_t out[16]) const {
+        store32BE(out, (uint32_t)(hi_ >> 32));
+        store32BE(out + 4, (uint32_t)hi_);
+        store32BE(out + 8, (uint32_t)(lo_ >> 32));
+        store32BE(out + 12, (uint32_t)lo_);
+    }
+
+private:
+    uint32_t rk_[32];
+    Sm4CtrIncrement inc_;
+    Sm4BlocksFunc kernel_;
+    size_t batch_;
+    uint64_t hi_, lo_;
+    uint8_t ks_[16];            // 最后一个分组的密钥流
+    size_t ksPos_, ksLen_;
+};
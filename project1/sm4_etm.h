@@ -0,0 +1,197 @@
+#pragma once
+// SM4-CTR + HMAC-SM3先加密后认证 (Encrypt-then-MAC)，用于要求SM4 + HMAC-SM3而不是GCM的场合。
+// 先整段CTR加密、再整段做HMAC要读两遍数据；这里按16 KiB分块，每块加密后趁密文还在L1/L2中
+// 立即交给HMAC，数据只读一遍。也可以让CTR与HMAC分别在两个线程上按块流水执行，
+// 两级之间用单生产者单消费者的无锁环传递块，环的容量限制了两级的距离，数据仍留在L2中
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#include "sm4.h"
+#include "sm4_key.h"
+#include "sm4_ctr.h"
+#include "../project4/sm3.h"
+
+// 每块的字节数：明文块与密文块合计32 KiB，留在L1/L2中
+const size_t kSm4EtmChunk = 16 * 1024;
+
+// 流水线中CTR最多领先HMAC的块数 (128 KiB)
+const size_t kSm4EtmRingSlots = 8;
+
+// 加密与认证使用互相独立的密钥
+struct Sm4EtmKey {
+    Sm4Key enc;
+    HmacSm3Key mac;
+
+    Sm4EtmKey() {
+    }
+
+    Sm4EtmKey(const uint8_t encKey[16], const uint8_t* macKey, size_t macKeyLen) {
+        set(encKey, macKey, macKeyLen);
+    }
+
+    void set(const uint8_t encKey[16], const uint8_t* macKey, size_t macKeyLen) {
+        enc.set(encKey);
+        mac.set(macKey, macKeyLen);
+    }
+};
+
+// -------------------------- 无锁环 --------------------------
+
+// 单生产者单消费者环：head只由消费者写，tail只由生产者写，各自用acquire读对方的位置。
+// N须为2的幂
+template <typename T, size_t N>
+class Sm4SpscRing {
+public:
+    Sm4SpscRing() : head_(0), tail_(0) {
+    }
+
+    // 环满时返回false
+    bool tryPush(const T& v) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        slots_[tail % N] = v;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 环空时返回false
+    bool tryPop(T& v) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        v = slots_[head % N];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 等待期间让出CPU，单核机器上对方线程才能推进
+    void push(const T& v) {
+        while (!tryPush(v)) {
+            std::this_thread::yield();
+        }
+    }
+
+    T pop() {
+        T v;
+        while (!tryPop(v)) {
+            std::this_thread::yield();
+        }
+        return v;
+    }
+
+private:
+    static_assert((N & (N - 1)) == 0, "N须为2的幂");
+
+    T slots_[N];
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+};
+
+// -------------------------- EtM --------------------------
+
+// 认证的数据沿用RFC 7518 5.2.2.1的构造：AAD || IV || C || AL，AL为AAD的比特数 (64位大端)，
+// 由它确定AAD与IV、密文的边界
+inline void sm4EtmMacBegin(HmacSm3& mac, const Sm4EtmKey& key, const uint8_t iv[16], const uint8_t* aad, size_t aadLen) {
+    mac.init(key.mac);
+    mac.update(aad, aadLen);
+    mac.update(iv, 16);
+}
+
+inline void sm4EtmMacEnd(HmacSm3& mac, size_t aadLen, uint8_t tag[32]) {
+    uint8_t al[8];
+    store32BE(al, (uint32_t)(((uint64_t)aadLen * 8) >> 32));
+    store32BE(al + 4, (uint32_t)((uint64_t)aadLen * 8));
+    mac.update(al, 8);
+    mac.finalize(tag);
+}
+
+// 按块交替执行CTR与HMAC。加密时先CTR再认证密文；解密时先认证密文再CTR，
+// 原地解密 (in == out) 时密文被覆盖之前已经并入HMAC。
+// pipelined时CTR (加密) 或HMAC (解密) 作为第一级在另一个线程上运行，当前线程执行第二级
+inline void sm4EtmRun(const Sm4EtmKey& key, const uint8_t iv[16], const uint8_t* aad, size_t aadLen,
+    const uint8_t* in, uint8_t* out, size_t len, bool decrypt, bool pipelined, uint8_t tag[32]) {
+    HmacSm3 mac;
+    sm4EtmMacBegin(mac, key, iv, aad, aadLen);
+    Sm4Ctr ctr(key.enc, iv, SM4_CTR_INC128);
+
+    auto ctrStage = [&](size_t off, size_t n) {
+        ctr.update(in + off, out + off, n);
+    };
+    auto macStage = [&](size_t off, size_t n) {
+        mac.update((decrypt ? in : out) + off, n);
+    };
+
+    if (!pipelined || len <= kSm4EtmChunk) {
+        for (size_t off = 0; off < len; off += kSm4EtmChunk) {
+            size_t n = std::min(kSm4EtmChunk, len - off);
+            if (!decrypt) {
+                ctrStage(off, n);
+                macStage(off, n);
+            }
+            else {
+                macStage(off, n);
+                ctrStage(off, n);
+            }
+        }
+    }
+    else {
+        // 环中传递已完成第一级的块的起始偏移
+        Sm4SpscRing<size_t, kSm4EtmRingSlots> ring;
+        std::thread first([&]() {
+            for (size_t off = 0; off < len; off += kSm4EtmChunk) {
+                size_t n = std::min(kSm4EtmChunk, len - off);
+                if (!decrypt) {
+                    ctrStage(off, n);
+                }
+                else {
+                    macStage(off, n);
+                }
+                ring.push(off);
+            }
+        });
+        for (size_t done = 0; done < len;) {
+            size_t off = ring.pop();
+            size_t n = std::min(kSm4EtmChunk, len - off);
+            if (!decrypt) {
+                macStage(off, n);
+            }
+            else {
+                ctrStage(off, n);
+            }
+            done = off + n;
+        }
+        first.join();
+    }
+    sm4EtmMacEnd(mac, aadLen, tag);
+}
+
+// iv为16字节初始计数器 (128位递增，与sm4crypt的CTR模式相同)，每条消息必须不同。
+// 输出32字节标签
+inline void sm4EtmEncrypt(const Sm4EtmKey& key, const uint8_t iv[16], const uint8_t* aad, size_t aadLen,
+    const uint8_t* in, uint8_t* out, size_t len, uint8_t tag[32], bool pipelined = false) {
+    sm4EtmRun(key, iv, aad, aadLen, in, out, len, false, pipelined, tag);
+}
+
+// 解密只读一遍数据；标签 (允许截断到16 ~ 32字节) 不符时把out清零后返回false
+inline bool sm4EtmDecrypt(const Sm4EtmKey& key, const uint8_t iv[16], const uint8_t* aad, size_t aadLen,
+    const uint8_t* in, uint8_t* out, size_t len, const uint8_t* tag, size_t tagLen, bool pipelined = false) {
+    if (tagLen < 16 || tagLen > 32) {
+        return false;
+    }
+    uint8_t expected[32];
+    sm4EtmRun(key, iv, aad, aadLen, in, out, len, true, pipelined, expected);
+    bool ok = sm4ConstTimeEqual(expected, tag, tagLen);
+    sm4Wipe(expected, sizeof(expected));
+    if (!ok) {
+        sm4Wipe(out, len);
+        return false;
+    }
+    return true;
+}
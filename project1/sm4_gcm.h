@@ -0,0 +1,1201 @@
+#pragma once
+// SM4-GCM：CTR部分用Sm4Ctr (32位计数器)，GHASH按CPU选择VPCLMULQDQ / PCLMULQDQ (H的各次幂聚合约简)，
+// 否则用每个密钥预先算好的Shoup 4位表。加密时CTR与GHASH拼接为一趟 (sm4GcmCrypt)。
+// 由project1-b.cpp中的SM4_GCM_Encrypt整理而来，去掉了Windows专用的_byteswap_ulong，
+// 并补上附加认证数据 (AAD)、带标签校验的解密、流式上下文和分散/聚集缓冲区的原地加解密
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/uio.h>
+#endif
+
+#include "sm4.h"
+#include "sm4_key.h"
+#include "sm4_ctr.h"
+
+// -------------------------- GHASH --------------------------
+
+// GF(2^128)元素，按GCM约定高位在前：hi的最高位为x^0的系数
+struct Gf128 {
+    uint64_t hi;
+    uint64_t lo;
+};
+
+inline Gf128 gf128Load(const uint8_t b[16]) {
+    Gf128 r;
+    r.hi = ((uint64_t)load32BE(b) << 32) | load32BE(b + 4);
+    r.lo = ((uint64_t)load32BE(b + 8) << 32) | load32BE(b + 12);
+    return r;
+}
+
+inline void gf128Store(uint8_t b[16], const Gf128& x) {
+    store32BE(b, (uint32_t)(x.hi >> 32));
+    store32BE(b + 4, (uint32_t)x.hi);
+    store32BE(b + 8, (uint32_t)(x.lo >> 32));
+    store32BE(b + 12, (uint32_t)x.lo);
+}
+
+// GF(2^128)乘法 (模x^128 + x^7 + x^2 + x + 1)：逐位处理Y，
+// 用掩码代替分支，耗时与H和数据无关
+inline Gf128 gf128Mul(const Gf128& X, const Gf128& Y) {
+    Gf128 Z = { 0, 0 };
+    Gf128 V = X;
+    for (int i = 0; i < 128; i++) {
+        uint64_t bit = (i < 64) ? (Y.hi >> (63 - i)) & 1 : (Y.lo >> (127 - i)) & 1;
+        uint64_t mask = 0 - bit;
+        Z.hi ^= V.hi & mask;
+        Z.lo ^= V.lo & mask;
+
+        uint64_t carry = 0 - (V.lo & 1);
+        V.lo = (V.lo >> 1) | (V.hi << 63);
+        V.hi = (V.hi >> 1) ^ (0xE100000000000000ull & carry);
+    }
+    return Z;
+}
+
+// Shoup 4位表：每个密钥预先算出H与全部16个4位多项式的乘积 (256字节)。
+// 乘法从Y的最低半字节开始，每步Z右移4位 (即乘x^4) 后异或M[半字节]，
+// 移出的4位用kGhashReduce4约简回最高16位。每个分组32次查表，比逐位乘法少得多。
+// 有PCLMULQDQ时改用H的1 ~ 16次幂做无进位乘法，见下文
+struct GhashKey {
+    Gf128 H;
+    Gf128 M[16];    // M[i] = i·H，i的最高位为x^0的系数
+    __m128i P[16];  // H^16, H^15, ..., H^1，寄存器形式为_mm_set_epi64x(hi, lo) (分组按字节反序装入)
+};
+
+// 移出的4位r对应的约简值 (r·(x^128 + x^7 + x^2 + x + 1)落在最高16位的部分)
+const uint64_t kGhashReduce4[16] = {
+    0x0000, 0x1C20, 0x3840, 0x2460, 0x7080, 0x6CA0, 0x48C0, 0x54E0,
+    0xE100, 0xFD20, 0xD940, 0xC560, 0x9180, 0x8DA0, 0xA9C0, 0xB5E0
+};
+
+// X·H查表计算：半字节顺序为lo的最低4位到hi的最高4位 (对应GCM位序中x^127到x^0)
+inline void gf128MulTableStep(Gf128& Z, const GhashKey& key, unsigned nibble) {
+    uint64_t rem = Z.lo & 0xF;
+    Z.lo = (Z.hi << 60) | (Z.lo >> 4);
+    Z.hi = (Z.hi >> 4) ^ (kGhashReduce4[rem] << 48) ^ key.M[nibble].hi;
+    Z.lo ^= key.M[nibble].lo;
+}
+
+inline Gf128 gf128MulTable(const Gf128& X, const GhashKey& key) {
+    Gf128 Z = key.M[X.lo & 0xF];
+    for (int n = 4; n < 64; n += 4) {
+        gf128MulTableStep(Z, key, (X.lo >> n) & 0xF);
+    }
+    for (int n = 0; n < 64; n += 4) {
+        gf128MulTableStep(Z, key, (X.hi >> n) & 0xF);
+    }
+    return Z;
+}
+
+// -------------------------- PCLMULQDQ --------------------------
+
+// 分组按字节反序装入寄存器后，GCM的位反射表示下两个元素的乘积
+// 就是128x128位无进位乘积左移1位再模约简 (Intel《Carry-Less Multiplication and Its Usage
+// for Computing the GCM Mode》中的算法)。约简是线性的，因此多个分组先各自与H的不同次幂相乘、
+// 256位乘积累加之后只需约简一次：Y' = (Y ^ X1)·H^n ^ X2·H^(n-1) ^ ... ^ Xn·H
+const __m128i kGhashBswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+inline __m128i gf128ToM128(const Gf128& x) {
+    return _mm_set_epi64x((long long)x.hi, (long long)x.lo);
+}
+
+inline Gf128 gf128FromM128(__m128i x) {
+    uint64_t q[2];
+    _mm_storeu_si128((__m128i*)q, x);
+    return Gf128{ q[1], q[0] };
+}
+
+// a·b的256位无进位乘积累加到 (lo, mid, hi)：mid为两个交叉项之和，约简时再折叠
+CPU_TARGET("pclmul")
+inline void ghashClmulAcc(__m128i a, __m128i b, __m128i& lo, __m128i& mid, __m128i& hi) {
+    lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(a, b, 0x00));
+    hi = _mm_xor_si128(hi, _mm_clmulepi64_si128(a, b, 0x11));
+    mid = _mm_xor_si128(mid, _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01)));
+}
+
+// 256位乘积 (hi:lo) 左移1位，再用x^128 + x^7 + x^2 + x + 1的移位形式约简到128位
+CPU_TARGET("sse2")
+inline __m128i ghashClmulReduce(__m128i lo, __m128i mid, __m128i hi) {
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    __m128i c0 = _mm_srli_epi32(lo, 31);
+    __m128i c1 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    __m128i top = _mm_srli_si128(c0, 12);
+    c1 = _mm_slli_si128(c1, 4);
+    c0 = _mm_slli_si128(c0, 4);
+    lo = _mm_or_si128(lo, c0);
+    hi = _mm_or_si128(_mm_or_si128(hi, c1), top);
+
+    __m128i t = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+    __m128i carry = _mm_srli_si128(t, 4);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(t, 12));
+    __m128i u = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+    u = _mm_xor_si128(u, carry);
+    return _mm_xor_si128(hi, _mm_xor_si128(lo, u));
+}
+
+CPU_TARGET("pclmul")
+inline __m128i ghashClmulMul(__m128i a, __m128i b) {
+    __m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+    ghashClmulAcc(a, b, lo, mid, hi);
+    return ghashClmulReduce(lo, mid, hi);
+}
+
+// H的1 ~ 16次幂，倒序存放：P[16 - n]起的n项正好与n个连续分组对应
+CPU_TARGET("pclmul")
+inline void ghashPowersPCLMUL(GhashKey& key) {
+    __m128i h = gf128ToM128(key.H);
+    __m128i p = h;
+    key.P[15] = p;
+    for (int i = 14; i >= 0; i--) {
+        p = ghashClmulMul(p, h);
+        key.P[i] = p;
+    }
+}
+
+// 每个密钥算一次：M[8] = H，M[4] = H·x，M[2] = H·x^2，M[1] = H·x^3，其余由异或组合；
+// CPU支持PCLMULQDQ时再算出H的各次幂
+inline void ghashInit(GhashKey& key, const Gf128& H) {
+    key.H = H;
+    key.M[0] = { 0, 0 };
+    key.M[8] = H;
+    Gf128 V = H;
+    for (int i = 4; i > 0; i >>= 1) {
+        uint64_t carry = 0 - (V.lo & 1);
+        V.lo = (V.lo >> 1) | (V.hi << 63);
+        V.hi = (V.hi >> 1) ^ (0xE100000000000000ull & carry);
+        key.M[i] = V;
+    }
+    for (int i = 2; i <= 8; i *= 2) {
+        for (int j = 1; j < i; j++) {
+            key.M[i + j].hi = key.M[i].hi ^ key.M[j].hi;
+            key.M[i + j].lo = key.M[i].lo ^ key.M[j].lo;
+        }
+    }
+
+    memset(key.P, 0, sizeof(key.P));
+    if (cpuHas(CPU_PCLMUL)) {
+        ghashPowersPCLMUL(key);
+    }
+}
+
+// -------------------------- GHASH内核 --------------------------
+
+// 对nblocks个完整分组做Y = (Y ^ X_i)·H
+typedef void (*GhashBlocksFunc)(Gf128& Y, const GhashKey& key, const uint8_t* data, size_t nblocks);
+
+inline void ghashBlocksBitwise(Gf128& Y, const GhashKey& key, const uint8_t* data, size_t nblocks) {
+    for (size_t i = 0; i < nblocks; i++) {
+        Gf128 X = gf128Load(data + 16 * i);
+        Y.hi ^= X.hi;
+        Y.lo ^= X.lo;
+        Y = gf128Mul(Y, key.H);
+    }
+}
+
+inline void ghashBlocksTable(Gf128& Y, const GhashKey& key, const uint8_t* data, size_t nblocks) {
+    for (size_t i = 0; i < nblocks; i++) {
+        Gf128 X = gf128Load(data + 16 * i);
+        Y.hi ^= X.hi;
+        Y.lo ^= X.lo;
+        Y = gf128MulTable(Y, key);
+    }
+}
+
+// 每8个分组与H^8 ~ H^1相乘后累加，约简一次；不足8个的尾部用对应的低次幂
+CPU_TARGET("ssse3,pclmul")
+inline void ghashBlocksPCLMUL(Gf128& Y, const GhashKey& key, const uint8_t* data, size_t nblocks) {
+    __m128i y = gf128ToM128(Y);
+    while (nblocks > 0) {
+        size_t n = nblocks < 8 ? nblocks : 8;
+        const __m128i* h = key.P + (16 - n);
+        __m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        __m128i x = _mm_xor_si128(y, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), kGhashBswap));
+        ghashClmulAcc(x, _mm_loadu_si128(h), lo, mid, hi);
+        for (size_t j = 1; j < n; j++) {
+            x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * j)), kGhashBswap);
+            ghashClmulAcc(x, _mm_loadu_si128(h + j), lo, mid, hi);
+        }
+        y = ghashClmulReduce(lo, mid, hi);
+        data += 16 * n;
+        nblocks -= n;
+    }
+    Y = gf128FromM128(y);
+}
+
+// 512位的4个128位通道异或到一起
+CPU_TARGET("avx512f")
+inline __m128i ghashFold512(__m512i x) {
+    __m256i t = _mm256_xor_si256(_mm512_castsi512_si256(x), _mm512_extracti64x4_epi64(x, 1));
+    return _mm_xor_si128(_mm256_castsi256_si128(t), _mm256_extracti128_si256(t, 1));
+}
+
+// 16个分组 (4个ZMM，分组为原始字节序) 分别乘H^16 ~ H^1后累加，约简一次；y为并入第一个分组的累加值
+CPU_TARGET("avx512f,avx512bw,vpclmulqdq,pclmul")
+inline __m128i ghashVPCLMUL16(__m128i y, const __m512i h[4], const __m512i x[4]) {
+    const __m512i bswap = _mm512_broadcast_i32x4(kGhashBswap);
+    __m512i lo = _mm512_setzero_si512(), mid = _mm512_setzero_si512(), hi = _mm512_setzero_si512();
+    for (int j = 0; j < 4; j++) {
+        __m512i v = _mm512_shuffle_epi8(x[j], bswap);
+        if (j == 0) {
+            v = _mm512_xor_si512(v, _mm512_zextsi128_si512(y));
+        }
+        lo = _mm512_xor_si512(lo, _mm512_clmulepi64_epi128(v, h[j], 0x00));
+        hi = _mm512_xor_si512(hi, _mm512_clmulepi64_epi128(v, h[j], 0x11));
+        mid = _mm512_ternarylogic_epi64(mid, _mm512_clmulepi64_epi128(v, h[j], 0x10),
+            _mm512_clmulepi64_epi128(v, h[j], 0x01), 0x96);
+    }
+    return ghashClmulReduce(ghashFold512(lo), ghashFold512(mid), ghashFold512(hi));
+}
+
+// VPCLMULQDQ：一条指令同时做4个分组的乘法，每次16个分组 (4个ZMM分别乘H^16 ~ H^13, ..., H^4 ~ H^1)，
+// 三个部分积各自用三元逻辑异或累加，约简一次
+CPU_TARGET("avx512f,avx512bw,vpclmulqdq,pclmul,ssse3")
+inline void ghashBlocksVPCLMUL(Gf128& Y, const GhashKey& key, const uint8_t* data, size_t nblocks) {
+    __m512i h[4], x[4];
+    for (int j = 0; j < 4; j++) {
+        h[j] = _mm512_loadu_si512((const void*)(key.P + 4 * j));
+    }
+    __m128i y = gf128ToM128(Y);
+    while (nblocks >= 16) {
+        for (int j = 0; j < 4; j++) {
+            x[j] = _mm512_loadu_si512((const void*)(data + 64 * j));
+        }
+        y = ghashVPCLMUL16(y, h, x);
+        data += 256;
+        nblocks -= 16;
+    }
+    Y = gf128FromM128(y);
+    if (nblocks > 0) {
+        ghashBlocksPCLMUL(Y, key, data, nblocks);
+    }
+}
+
+struct GhashKernel {
+    const char* name;               // 内核名，可通过环境变量GHASH_KERNEL指定
+    uint32_t required;
+    bool constant_time;             // 查表版本的下标来自数据，可能经缓存时间泄露
+    GhashBlocksFunc ghash_blocks;
+};
+
+// 按优先级从高到低排列
+inline constexpr GhashKernel kGhashKernels[] = {
+    { "vpclmul-avx512", CPU_VPCLMULQDQ | CPU_PCLMUL | CPU_AVX512F | CPU_AVX512BW, true, ghashBlocksVPCLMUL },
+    { "pclmul", CPU_PCLMUL | CPU_SSSE3, true, ghashBlocksPCLMUL },
+    { "table", 0, false, ghashBlocksTable },
+    { "bitwise", 0, true, ghashBlocksBitwise },
+};
+
+// 自检：McGrew/Viega GCM规范测试用例2的GHASH (H与一个密文分组)，
+// 以及随机H、随机数据在各种分组数下与逐位乘法对照
+const uint8_t kGhashTestH[16] = {
+    0x66, 0xE9, 0x4B, 0xD4, 0xEF, 0x8A, 0x2C, 0x3B, 0x88, 0x4C, 0xFA, 0x59, 0xCA, 0x34, 0x2B, 0x2E
+};
+const uint8_t kGhashTestData[32] = {
+    0x03, 0x88, 0xDA, 0xCE, 0x60, 0xB6, 0xA3, 0x92, 0xF3, 0x28, 0xC2, 0xB9, 0x71, 0xB2, 0xFE, 0x78,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80
+};
+const uint8_t kGhashTestResult[16] = {
+    0xF3, 0x8C, 0xBB, 0x1A, 0xD6, 0x92, 0x23, 0xDC, 0xC3, 0x45, 0x7A, 0xE5, 0xB6, 0xB0, 0xF8, 0x85
+};
+
+const size_t kGhashSelfTestSizes[] = { 67, 16, 9, 8, 7, 1 };
+
+inline bool ghashSelfTestKernel(GhashBlocksFunc f) {
+    GhashKey key;
+    ghashInit(key, gf128Load(kGhashTestH));
+    Gf128 Y = { 0, 0 };
+    f(Y, key, kGhashTestData, 2);
+    uint8_t out[16];
+    gf128Store(out, Y);
+    if (memcmp(out, kGhashTestResult, 16) != 0) {
+        return false;
+    }
+
+    uint64_t seed = 0x4748415348544553ull;
+    uint8_t h[16], data[67 * 16];
+    for (size_t n : kGhashSelfTestSizes) {
+        selfTestFill(h, 16, seed);
+        selfTestFill(data, 16 * n, seed);
+        ghashInit(key, gf128Load(h));
+        Gf128 expected = { 0, 0 }, actual = { 0, 0 };
+        ghashBlocksBitwise(expected, key, data, n);
+        f(actual, key, data, n);
+        if (expected.hi != actual.hi || expected.lo != actual.lo) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline std::vector<KernelSelfTest> ghashRunSelfTest() {
+    std::vector<KernelSelfTest> results;
+    for (const GhashKernel& k : kGhashKernels) {
+        bool supported = cpuHas(k.required);
+        results.push_back({ k.name, supported, supported && ghashSelfTestKernel(k.ghash_blocks) });
+    }
+    return results;
+}
+
+// 自检结果，顺序与kGhashKernels相同
+inline const std::vector<KernelSelfTest>& ghashSelfTestResults() {
+    static const std::vector<KernelSelfTest> results = ghashRunSelfTest();
+    return results;
+}
+
+inline bool ghashKernelUsable(const GhashKernel& k) {
+    return ghashSelfTestResults()[&k - kGhashKernels].passed;
+}
+
+inline const GhashKernel* ghashFindKernel(const char* name) {
+    for (const GhashKernel& k : kGhashKernels) {
+        if (strcmp(k.name, name) == 0) {
+            return &k;
+        }
+    }
+    return nullptr;
+}
+
+// 与sm4SelectKernel相同的规则：GHASH_KERNEL可强制指定，常数时间策略下不用查表版本
+inline const GhashKernel* ghashSelectKernel() {
+    bool ct = sm4ConstantTimePolicy();
+    const char* forced = getenv("GHASH_KERNEL");
+    if (forced != nullptr && forced[0] != '\0') {
+        const GhashKernel* k = ghashFindKernel(forced);
+        if (k != nullptr && ghashKernelUsable(*k) && (!ct || k->constant_time)) {
+            return k;
+        }
+        fprintf(stderr, "GHASH_KERNEL=%s 不存在、当前CPU不支持、未通过自检或不满足常数时间要求，改为自动选择\n", forced);
+    }
+
+    for (const GhashKernel& k : kGhashKernels) {
+        if (ghashKernelUsable(k) && (!ct || k.constant_time)) {
+            return &k;
+        }
+    }
+    return ghashFindKernel("bitwise");
+}
+
+inline const GhashKernel* const g_ghashKernel = ghashSelectKernel();
+
+// Y = (Y ^ X_i)·H，对data的每个16字节分组；最后不足16字节的部分补零
+inline void ghashUpdate(Gf128& Y, const GhashKey& H, const uint8_t* data, size_t len) {
+    size_t n = len / 16;
+    if (n > 0) {
+        g_ghashKernel->ghash_blocks(Y, H, data, n);
+    }
+    if (len % 16 != 0) {
+        uint8_t block[16] = { 0 };
+        memcpy(block, data + 16 * n, len % 16);
+        g_ghashKernel->ghash_blocks(Y, H, block, 1);
+    }
+}
+
+// 长度分组：len(A) || len(C)，均为64位大端比特数
+inline void ghashLengths(Gf128& Y, const GhashKey& H, uint64_t aadLen, uint64_t textLen) {
+    uint8_t block[16];
+    store32BE(block, (uint32_t)((aadLen * 8) >> 32));
+    store32BE(block + 4, (uint32_t)(aadLen * 8));
+    store32BE(block + 8, (uint32_t)((textLen * 8) >> 32));
+    store32BE(block + 12, (uint32_t)(textLen * 8));
+    ghashUpdate(Y, H, block, 16);
+}
+
+// -------------------------- CTR + GHASH拼接 --------------------------
+
+// 从计数器ctr (32位递增) 开始加密或解密nblocks个完整分组，同时把密文并入S；ctr前移nblocks。
+// 加密时哈希刚写出的密文，解密时哈希输入，数据只读一遍，不需要单独的密文副本
+typedef void (*Sm4GcmBlocksFunc)(const uint32_t rk[32], const GhashKey& H, uint8_t ctr[16], Gf128& S,
+    const uint8_t* in, uint8_t* out, size_t nblocks, bool decrypt);
+
+// 通用版本：每批取批量内核的首选分组数 (最多8 KiB，在L1内) 先由批量内核生成密钥流，
+// 异或后立即交给GHASH内核，密文不会在两趟之间被挤出缓存
+inline void sm4GcmBlocksGeneric(const uint32_t rk[32], const GhashKey& H, uint8_t ctr[16], Gf128& S,
+    const uint8_t* in, uint8_t* out, size_t nblocks, bool decrypt) {
+    Sm4BlocksFunc kernel = g_sm4Kernel->encrypt_blocks;
+    GhashBlocksFunc ghash = g_ghashKernel->ghash_blocks;
+    const size_t batch = g_sm4Kernel->batch_blocks;
+    const size_t used = std::min(nblocks, batch);
+    uint64_t hi = ((uint64_t)load32BE(ctr) << 32) | load32BE(ctr + 4);
+    uint64_t lo = ((uint64_t)load32BE(ctr + 8) << 32) | load32BE(ctr + 12);
+    alignas(64) uint8_t ks[kSm4MaxBatch * 16];
+    while (nblocks > 0) {
+        size_t n = std::min(nblocks, batch);
+        sm4CtrFill(ks, n, hi, lo, SM4_CTR_INC32);
+        kernel(rk, ks, ks, n);
+        if (decrypt) {
+            ghash(S, H, in, n);
+        }
+        xorBytes(out, in, ks, 16 * n);
+        if (!decrypt) {
+            ghash(S, H, out, n);
+        }
+        in += 16 * n;
+        out += 16 * n;
+        nblocks -= n;
+    }
+    store32BE(ctr + 12, (uint32_t)lo);
+    sm4Wipe(ks, 16 * used);
+}
+
+// GFNI + VPCLMULQDQ拼接内核：每次16个分组，计数器直接在转置后的寄存器中生成，
+// 密钥流与输入异或后就在寄存器里做GHASH。加密时上一组密文的无进位乘法排在本组SM4轮函数之前，
+// 两者没有数据依赖，乱序执行可以让CLMUL与GFNI重叠；解密时直接哈希本组输入
+CPU_TARGET("avx2,avx512f,avx512bw,gfni,vpclmulqdq,pclmul,ssse3")
+inline void sm4GcmBlocksGFNI_VPCLMUL(const uint32_t rk[32], const GhashKey& H, uint8_t ctr[16], Gf128& S,
+    const uint8_t* in, uint8_t* out, size_t nblocks, bool decrypt) {
+    const __m512i bswap = _mm512_broadcast_i32x4(kBswap32);
+    // 转置后第d个32位元素对应第 (d / 4) + 4 * (d % 4) 个分组
+    const __m512i offsets = _mm512_set_epi32(15, 11, 7, 3, 14, 10, 6, 2, 13, 9, 5, 1, 12, 8, 4, 0);
+    const __m512i c0 = _mm512_set1_epi32((int)load32BE(ctr));
+    const __m512i c1 = _mm512_set1_epi32((int)load32BE(ctr + 4));
+    const __m512i c2 = _mm512_set1_epi32((int)load32BE(ctr + 8));
+    uint32_t c3 = load32BE(ctr + 12);
+    __m512i h[4], prev[4];
+    for (int j = 0; j < 4; j++) {
+        h[j] = _mm512_loadu_si512((const void*)(H.P + 4 * j));
+    }
+    __m128i y = gf128ToM128(S);
+    bool pending = false;
+
+    while (nblocks >= 16) {
+        __m512i x[4];
+        for (int j = 0; j < 4; j++) {
+            x[j] = _mm512_loadu_si512((const void*)(in + 64 * j));
+        }
+        if (decrypt) {
+            y = ghashVPCLMUL16(y, h, x);
+        }
+        else if (pending) {
+            y = ghashVPCLMUL16(y, h, prev);
+        }
+
+        __m512i X0 = c0, X1 = c1, X2 = c2;
+        __m512i X3 = _mm512_add_epi32(_mm512_set1_epi32((int)c3), offsets);
+        sm4RoundsGFNI16(X0, X1, X2, X3, rk);
+        transpose4x4_avx512(X3, X2, X1, X0);
+        prev[0] = _mm512_xor_si512(x[0], _mm512_shuffle_epi8(X3, bswap));
+        prev[1] = _mm512_xor_si512(x[1], _mm512_shuffle_epi8(X2, bswap));
+        prev[2] = _mm512_xor_si512(x[2], _mm512_shuffle_epi8(X1, bswap));
+        prev[3] = _mm512_xor_si512(x[3], _mm512_shuffle_epi8(X0, bswap));
+        for (int j = 0; j < 4; j++) {
+            _mm512_storeu_si512((void*)(out + 64 * j), prev[j]);
+        }
+        pending = !decrypt;
+
+        c3 += 16;
+        in += 256;
+        out += 256;
+        nblocks -= 16;
+    }
+    if (pending) {
+        y = ghashVPCLMUL16(y, h, prev);
+    }
+    S = gf128FromM128(y);
+    store32BE(ctr + 12, c3);
+
+    if (nblocks > 0) {
+        sm4GcmBlocksGeneric(rk, H, ctr, S, in, out, nblocks, decrypt);
+    }
+}
+
+// 自检：拼接内核与通用版本在随机密钥、随机数据上加密和解密的结果 (输出、GHASH、计数器) 对照
+inline bool sm4GcmSelfTestBlocks(Sm4GcmBlocksFunc f) {
+    uint64_t seed = 0x53544954434847ull;
+    uint8_t key[16], h[16], ctr0[16], in[67 * 16], expected[67 * 16], actual[67 * 16];
+    selfTestFill(key, 16, seed);
+    selfTestFill(h, 16, seed);
+    selfTestFill(ctr0, 16, seed);
+    selfTestFill(in, sizeof(in), seed);
+    ctr0[12] = ctr0[13] = 0xFF;    // 让32位计数器在这批分组中回绕
+    uint32_t rk[32];
+    sm4ExpandKey(key, rk);
+    GhashKey H;
+    ghashInit(H, gf128Load(h));
+    for (int decrypt = 0; decrypt < 2; decrypt++) {
+        uint8_t ctrA[16], ctrB[16];
+        memcpy(ctrA, ctr0, 16);
+        memcpy(ctrB, ctr0, 16);
+        Gf128 SA = { 0, 0 }, SB = { 0, 0 };
+        sm4GcmBlocksGeneric(rk, H, ctrA, SA, in, expected, 67, decrypt != 0);
+        f(rk, H, ctrB, SB, in, actual, 67, decrypt != 0);
+        if (memcmp(expected, actual, sizeof(actual)) != 0 || memcmp(ctrA, ctrB, 16) != 0 ||
+            SA.hi != SB.hi || SA.lo != SB.lo) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// SM4和GHASH分派分别选中gfni-avx512与vpclmul-avx512时才用拼接内核，
+// 因此SM4_KERNEL、GHASH_KERNEL和常数时间策略对它同样有效
+inline Sm4GcmBlocksFunc sm4GcmSelectBlocks() {
+    if (strcmp(g_sm4Kernel->name, "gfni-avx512") == 0 && g_ghashKernel->ghash_blocks == ghashBlocksVPCLMUL &&
+        sm4GcmSelfTestBlocks(sm4GcmBlocksGFNI_VPCLMUL)) {
+        return sm4GcmBlocksGFNI_VPCLMUL;
+    }
+    return sm4GcmBlocksGeneric;
+}
+
+inline const Sm4GcmBlocksFunc g_sm4GcmBlocks = sm4GcmSelectBlocks();
+
+// 从计数器ctr开始加密或解密len字节并把密文并入S，in与out可以相同。
+// 最后不足16字节的部分单独生成一个密钥流分组，密文补零后并入GHASH (之后不能再追加数据)
+inline void sm4GcmCrypt(const uint32_t rk[32], const GhashKey& H, uint8_t ctr[16], Gf128& S,
+    const uint8_t* in, uint8_t* out, size_t len, bool decrypt) {
+    size_t n = len / 16;
+    if (n > 0) {
+        g_sm4GcmBlocks(rk, H, ctr, S, in, out, n, decrypt);
+    }
+    size_t r = len % 16;
+    if (r != 0) {
+        uint8_t ks[16], block[16] = { 0 };
+        g_sm4Kernel->encrypt_blocks(rk, ctr, ks, 1);
+        sm4CounterAdd(ctr, 1, SM4_CTR_INC32);
+        memcpy(block, in + 16 * n, r);
+        xorBytes(out + 16 * n, in + 16 * n, ks, r);
+        if (!decrypt) {
+            memcpy(block, out + 16 * n, r);
+        }
+        ghashUpdate(S, H, block, 16);
+        sm4Wipe(ks, sizeof(ks));
+    }
+}
+
+// -------------------------- GCM --------------------------
+
+// J0 = IV || 0^31 || 1 (12字节IV)，否则J0 = GHASH(IV || 0填充 || 0^64 || len(IV))
+inline void sm4GcmJ0(const GhashKey& H, const uint8_t* iv, size_t ivLen, uint8_t J0[16]) {
+    if (ivLen == 12) {
+        memcpy(J0, iv, 12);
+        J0[12] = J0[13] = J0[14] = 0;
+        J0[15] = 1;
+    }
+    else {
+        Gf128 Y = { 0, 0 };
+        ghashUpdate(Y, H, iv, ivLen);
+        ghashLengths(Y, H, 0, ivLen);
+        gf128Store(J0, Y);
+    }
+}
+
+// H = E_K(0^128)，并建好H的乘法表，再由IV算出J0
+inline void sm4GcmInit(const Sm4Key& key, const uint8_t* iv, size_t ivLen, GhashKey& H, uint8_t J0[16]) {
+    uint8_t h[16] = { 0 };
+    sm4_encrypt_blocks(key, h, h, 1);
+    ghashInit(H, gf128Load(h));
+    sm4GcmJ0(H, iv, ivLen, J0);
+}
+
+// 标签 = E_K(J0) ^ GHASH(A, C)
+inline void sm4GcmTag(const Sm4Key& key, const uint8_t J0[16], const Gf128& S, uint8_t tag[16]) {
+    uint8_t ek[16], s[16];
+    sm4_encrypt_blocks(key, J0, ek, 1);
+    gf128Store(s, S);
+    xorBlock16(tag, ek, s);
+}
+
+// 常数时间比较认证标签
+inline bool sm4GcmTagEqual(const uint8_t* a, const uint8_t* b, size_t len) {
+    return sm4ConstTimeEqual(a, b, len);
+}
+
+// 从J0 + 1开始的32位计数器加密/解密
+inline void sm4GcmCtr(const Sm4Key& key, const uint8_t J0[16], const uint8_t* in, uint8_t* out, size_t len) {
+    uint8_t ctr[16];
+    memcpy(ctr, J0, 16);
+    sm4CounterAdd(ctr, 1, SM4_CTR_INC32);
+    Sm4Ctr c(key, ctr, SM4_CTR_INC32);
+    c.update(in, out, len);
+}
+
+inline void sm4GcmEncrypt(const Sm4Key& key, const uint8_t* iv, size_t ivLen, const uint8_t* aad, size_t aadLen,
+    const uint8_t* in, uint8_t* out, size_t len, uint8_t tag[16]) {
+    GhashKey H;
+    uint8_t J0[16];
+    sm4GcmInit(key, iv, ivLen, H, J0);
+
+    // CTR与GHASH一趟完成，长度分组最后并入
+    Gf128 S = { 0, 0 };
+    ghashUpdate(S, H, aad, aadLen);
+    uint8_t ctr[16];
+    memcpy(ctr, J0, 16);
+    sm4CounterAdd(ctr, 1, SM4_CTR_INC32);
+    sm4GcmCrypt(key.enc, H, ctr, S, in, out, len, false);
+    ghashLengths(S, H, aadLen, len);
+    sm4GcmTag(key, J0, S, tag);
+}
+
+// 先校验标签再解密：标签不符时返回false，out不被写入
+inline bool sm4GcmDecrypt(const Sm4Key& key, const uint8_t* iv, size_t ivLen, const uint8_t* aad, size_t aadLen,
+    const uint8_t* in, uint8_t* out, size_t len, const uint8_t tag[16]) {
+    GhashKey H;
+    uint8_t J0[16];
+    sm4GcmInit(key, iv, ivLen, H, J0);
+
+    Gf128 S = { 0, 0 };
+    ghashUpdate(S, H, aad, aadLen);
+    ghashUpdate(S, H, in, len);
+    ghashLengths(S, H, aadLen, len);
+    uint8_t expected[16];
+    sm4GcmTag(key, J0, S, expected);
+    if (!sm4GcmTagEqual(expected, tag, 16)) {
+        return false;
+    }
+
+    sm4GcmCtr(key, J0, in, out, len);
+    return true;
+}
+
+// -------------------------- 流式GCM上下文 --------------------------
+
+// 密钥上下文：轮密钥与H的乘法表 (含H的各次幂) 每个密钥只算一次，可供多个Sm4Gcm同时只读使用
+struct Sm4GcmKey {
+    Sm4Key key;
+    GhashKey H;
+
+    Sm4GcmKey() {
+        memset(&H, 0, sizeof(H));
+    }
+
+    explicit Sm4GcmKey(const uint8_t key[16]) {
+        set(key);
+    }
+
+    ~Sm4GcmKey() {
+        sm4Wipe(&H, sizeof(H));
+    }
+
+    void set(const uint8_t k[16]) {
+        key.set(k);
+        uint8_t h[16] = { 0 };
+        sm4_encrypt_blocks(key, h, h, 1);
+        ghashInit(H, gf128Load(h));
+        sm4Wipe(h, sizeof(h));
+    }
+};
+
+enum Sm4GcmDirection {
+    SM4_GCM_ENCRYPT,
+    SM4_GCM_DECRYPT,
+};
+
+// 单条消息最多2^36 - 32字节 (NIST SP 800-38D)
+const uint64_t kSm4GcmMaxText = (1ull << 36) - 32;
+
+// 流式SM4-GCM：init后先用update_aad输入附加认证数据，再用update输入明文或密文，
+// 两者都可以分成任意长度的片段，in与out可以相同。加密用finalize取标签，解密用verify常数时间校验标签。
+// 上下文只保存固定大小的状态，处理过程中不分配内存；密钥上下文在finalize/verify之前不得释放。
+// 注意：解密时update已经输出了明文，verify返回false时调用者必须丢弃全部输出
+class Sm4Gcm {
+public:
+    Sm4Gcm() : key_(nullptr), state_(STATE_IDLE), decrypt_(false) {
+    }
+
+    ~Sm4Gcm() {
+        sm4Wipe(this, sizeof(*this));
+    }
+
+    Sm4Gcm(const Sm4Gcm&) = delete;
+    Sm4Gcm& operator=(const Sm4Gcm&) = delete;
+
+    // 开始一条消息：J0由IV算出，E_K(J0) 立即算好留给标签使用。ivLen为0时返回false
+    bool init(const Sm4GcmKey& key, const uint8_t* iv, size_t ivLen, Sm4GcmDirection dir = SM4_GCM_ENCRYPT) {
+        if (ivLen == 0) {
+            state_ = STATE_IDLE;
+            return false;
+        }
+        key_ = &key;
+        decrypt_ = (dir == SM4_GCM_DECRYPT);
+        uint8_t J0[16];
+        sm4GcmJ0(key.H, iv, ivLen, J0);
+        sm4_encrypt_blocks(key.key, J0, ekJ0_, 1);
+        memcpy(ctr_, J0, 16);
+        sm4CounterAdd(ctr_, 1, SM4_CTR_INC32);
+        S_ = { 0, 0 };
+        aadLen_ = textLen_ = 0;
+        partial_ = 0;
+        state_ = STATE_AAD;
+        return true;
+    }
+
+    // 附加认证数据，必须在第一次update之前输入
+    bool update_aad(const uint8_t* aad, size_t len) {
+        if (state_ != STATE_AAD) {
+            return false;
+        }
+        aadLen_ += len;
+        absorb(aad, len);
+        return true;
+    }
+
+    // 加密或解密len字节。超过单条消息的长度上限或状态不对时返回false，out不被写入
+    bool update(const uint8_t* in, uint8_t* out, size_t len) {
+        if (state_ == STATE_AAD) {
+            flushPartial();
+            state_ = STATE_TEXT;
+        }
+        if (state_ != STATE_TEXT || len > kSm4GcmMaxText - textLen_) {
+            return false;
+        }
+        textLen_ += len;
+
+        // 先用完上一个分组剩下的密钥流
+        if (partial_ > 0) {
+            size_t n = std::min(len, 16 - partial_);
+            crypt(in, out, n);
+            in += n;
+            out += n;
+            len -= n;
+        }
+
+        // 完整分组走CTR + GHASH拼接内核
+        size_t blocks = len / 16;
+        if (blocks > 0) {
+            g_sm4GcmBlocks(key_->key.enc, key_->H, ctr_, S_, in, out, blocks, decrypt_);
+            in += 16 * blocks;
+            out += 16 * blocks;
+            len -= 16 * blocks;
+        }
+
+        // 剩余不足一个分组：生成一个密钥流分组，没用完的字节留给下一次
+        if (len > 0) {
+            g_sm4Kernel->encrypt_blocks(key_->key.enc, ctr_, ks_, 1);
+            sm4CounterAdd(ctr_, 1, SM4_CTR_INC32);
+            crypt(in, out, len);
+        }
+        return true;
+    }
+
+    // 加密结束，输出16字节标签。状态不对时返回false
+    bool finalize(uint8_t tag[16]) {
+        return !decrypt_ && computeTag(tag);
+    }
+
+    // 解密结束，常数时间比较标签 (允许截断到12 ~ 16字节)。标签不符或状态不对时返回false
+    bool verify(const uint8_t* tag, size_t tagLen) {
+        uint8_t expected[16];
+        if (!decrypt_ || tagLen < 12 || tagLen > 16 || !computeTag(expected)) {
+            return false;
+        }
+        bool ok = sm4GcmTagEqual(expected, tag, tagLen);
+        sm4Wipe(expected, sizeof(expected));
+        return ok;
+    }
+
+private:
+    enum State {
+        STATE_IDLE,     // 未init，或已finalize/verify
+        STATE_AAD,
+        STATE_TEXT,
+    };
+
+    // AAD并入GHASH：先补满buf_中的残余分组，再整块处理，剩余字节留在buf_
+    void absorb(const uint8_t* data, size_t len) {
+        if (partial_ > 0) {
+            size_t n = std::min(len, 16 - partial_);
+            memcpy(buf_ + partial_, data, n);
+            partial_ += n;
+            data += n;
+            len -= n;
+            if (partial_ < 16) {
+                return;
+            }
+            g_ghashKernel->ghash_blocks(S_, key_->H, buf_, 1);
+            partial_ = 0;
+        }
+        size_t blocks = len / 16;
+        if (blocks > 0) {
+            g_ghashKernel->ghash_blocks(S_, key_->H, data, blocks);
+        }
+        memcpy(buf_, data + 16 * blocks, len % 16);
+        partial_ = len % 16;
+    }
+
+    // 用ks_中从partial_开始的n字节密钥流加解密，密文记入buf_；凑满一个分组时并入GHASH
+    void crypt(const uint8_t* in, uint8_t* out, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            uint8_t c = decrypt_ ? in[i] : (uint8_t)(in[i] ^ ks_[partial_ + i]);
+            out[i] = in[i] ^ ks_[partial_ + i];
+            buf_[partial_ + i] = c;
+        }
+        partial_ += n;
+        if (partial_ == 16) {
+            g_ghashKernel->ghash_blocks(S_, key_->H, buf_, 1);
+            partial_ = 0;
+        }
+    }
+
+    // 不足一个分组的AAD或密文补零后并入GHASH
+    void flushPartial() {
+        if (partial_ > 0) {
+            memset(buf_ + partial_, 0, 16 - partial_);
+            g_ghashKernel->ghash_blocks(S_, key_->H, buf_, 1);
+            partial_ = 0;
+        }
+    }
+
+    bool computeTag(uint8_t tag[16]) {
+        if (state_ == STATE_IDLE) {
+            return false;
+        }
+        flushPartial();
+        ghashLengths(S_, key_->H, aadLen_, textLen_);
+        uint8_t s[16];
+        gf128Store(s, S_);
+        xorBlock16(tag, ekJ0_, s);
+        sm4Wipe(ks_, sizeof(ks_));
+        sm4Wipe(buf_, sizeof(buf_));
+        state_ = STATE_IDLE;
+        return true;
+    }
+
+    const Sm4GcmKey* key_;
+    State state_;
+    bool decrypt_;
+    uint8_t ekJ0_[16];      // E_K(J0)
+    uint8_t ctr_[16];       // 下一个尚未使用的计数器
+    Gf128 S_;
+    uint64_t aadLen_, textLen_;
+    uint8_t ks_[16];        // 当前分组的密钥流
+    uint8_t buf_[16];       // 尚未凑满一个分组的AAD或密文
+    size_t partial_;        // buf_中的字节数，也是ks_中已用的字节数
+};
+
+// -------------------------- 小报文批量处理 --------------------------
+
+// 同一密钥下的一条记录 (例如一个TLS记录或一个网络报文)
+struct Sm4GcmRecord {
+    const uint8_t* iv;
+    size_t ivLen;               // 通常为12；其他长度按GCM规范由GHASH得到J0
+    const uint8_t* aad;
+    size_t aadLen;
+    const uint8_t* in;
+    uint8_t* out;               // 可以与in相同
+    size_t len;
+    uint8_t tag[16];            // 加密时输出；解密时为待校验的标签
+    bool ok;                    // 处理结果：IV为空或解密时标签不符为false
+};
+
+// 一批记录的J0与计数器分组合计不超过这么多时放进同一个缓冲区，一次交给批量内核 (8 KiB，在L1内)；
+// 单条记录放不下时单独走拼接内核
+const size_t kSm4GcmBatchBlocks = 512;
+
+// ks依次为E_K(J0), E_K(J0 + 1), ...：异或出输出，GHASH并入AAD、密文和长度分组，得到或校验标签
+inline void sm4GcmRecordFinish(const Sm4GcmKey& key, Sm4GcmRecord& r, const uint8_t* ks, bool decrypt) {
+    Gf128 S = { 0, 0 };
+    ghashUpdate(S, key.H, r.aad, r.aadLen);
+    if (decrypt) {
+        ghashUpdate(S, key.H, r.in, r.len);
+    }
+    xorBytes(r.out, r.in, ks + 16, r.len);
+    if (!decrypt) {
+        ghashUpdate(S, key.H, r.out, r.len);
+    }
+    ghashLengths(S, key.H, r.aadLen, r.len);
+
+    uint8_t tag[16];
+    gf128Store(tag, S);
+    xorBlock16(tag, tag, ks);
+    if (!decrypt) {
+        memcpy(r.tag, tag, 16);
+        r.ok = true;
+    }
+    else {
+        r.ok = sm4GcmTagEqual(tag, r.tag, 16);
+        if (!r.ok) {
+            sm4Wipe(r.out, r.len);
+        }
+    }
+}
+
+// 长记录：E_K(J0) 单独算，数据走CTR + GHASH拼接内核
+inline void sm4GcmRecordLarge(const Sm4GcmKey& key, Sm4GcmRecord& r, const uint8_t J0[16], bool decrypt) {
+    uint8_t ekJ0[16], ctr[16], tag[16], s[16];
+    sm4_encrypt_blocks(key.key, J0, ekJ0, 1);
+    memcpy(ctr, J0, 16);
+    sm4CounterAdd(ctr, 1, SM4_CTR_INC32);
+    Gf128 S = { 0, 0 };
+    ghashUpdate(S, key.H, r.aad, r.aadLen);
+    sm4GcmCrypt(key.key.enc, key.H, ctr, S, r.in, r.out, r.len, decrypt);
+    ghashLengths(S, key.H, r.aadLen, r.len);
+    gf128Store(s, S);
+    xorBlock16(tag, ekJ0, s);
+    if (!decrypt) {
+        memcpy(r.tag, tag, 16);
+        r.ok = true;
+    }
+    else {
+        r.ok = sm4GcmTagEqual(tag, r.tag, 16);
+        if (!r.ok) {
+            sm4Wipe(r.out, r.len);
+        }
+    }
+}
+
+// 批量加密或解密：H及其各次幂取自密钥上下文，不再逐条计算；
+// 连续若干条记录的J0和全部计数器分组由SSSE3依次写进同一个缓冲区，一次批量内核调用
+// 同时得到各条记录的E_K(J0) 和密钥流，然后逐条异或、GHASH并输出标签。
+// 返回所有记录的ok是否都为true
+inline bool sm4GcmBatch(const Sm4GcmKey& key, Sm4GcmRecord* records, size_t count, bool decrypt) {
+    alignas(64) uint8_t ks[kSm4GcmBatchBlocks * 16];
+    size_t first = 0, used = 0;
+    bool allOk = true;
+
+    // 处理缓冲区中[first, end) 这些记录
+    auto flush = [&](size_t end) {
+        if (used == 0) {
+            return;
+        }
+        g_sm4Kernel->encrypt_blocks(key.key.enc, ks, ks, used);
+        size_t off = 0;
+        for (size_t i = first; i < end; i++) {
+            Sm4GcmRecord& r = records[i];
+            if (r.ivLen == 0) {
+                continue;
+            }
+            sm4GcmRecordFinish(key, r, ks + 16 * off, decrypt);
+            allOk = allOk && r.ok;
+            off += 1 + (r.len + 15) / 16;
+        }
+        used = 0;
+    };
+
+    for (size_t i = 0; i < count; i++) {
+        Sm4GcmRecord& r = records[i];
+        if (r.ivLen == 0) {
+            r.ok = false;
+            allOk = false;
+            continue;
+        }
+        uint8_t J0[16];
+        sm4GcmJ0(key.H, r.iv, r.ivLen, J0);
+        size_t blocks = 1 + (r.len + 15) / 16;
+        if (blocks > kSm4GcmBatchBlocks) {
+            flush(i);
+            first = i + 1;
+            sm4GcmRecordLarge(key, r, J0, decrypt);
+            allOk = allOk && r.ok;
+            continue;
+        }
+        if (used + blocks > kSm4GcmBatchBlocks) {
+            flush(i);
+            first = i;
+        }
+        uint64_t hi = ((uint64_t)load32BE(J0) << 32) | load32BE(J0 + 4);
+        uint64_t lo = ((uint64_t)load32BE(J0 + 8) << 32) | load32BE(J0 + 12);
+        sm4CtrFill(ks + 16 * used, blocks, hi, lo, SM4_CTR_INC32);
+        used += blocks;
+    }
+    flush(count);
+    sm4Wipe(ks, sizeof(ks));
+    return allOk;
+}
+
+inline bool sm4GcmEncryptBatch(const Sm4GcmKey& key, Sm4GcmRecord* records, size_t count) {
+    return sm4GcmBatch(key, records, count, false);
+}
+
+// 标签不符的记录ok为false，其输出被清零
+inline bool sm4GcmDecryptBatch(const Sm4GcmKey& key, Sm4GcmRecord* records, size_t count) {
+    return sm4GcmBatch(key, records, count, true);
+}
+
+// -------------------------- 分散/聚集缓冲区 --------------------------
+
+// 一段缓冲区：POSIX下就是struct iovec，可以直接传入readv/writev/recvmsg用的数组；
+// Windows下定义一个字段相同的结构
+#if defined(_WIN32)
+struct Sm4Iovec {
+    void* iov_base;
+    size_t iov_len;
+};
+#else
+typedef struct iovec Sm4Iovec;
+#endif
+
+// 原地加密一串缓冲区：每段依次交给Sm4Gcm，跨段边界的不足一个分组的密钥流和密文由上下文接续，
+// 结果与把所有段拼接后一次加密相同。标签写入调用者给出的位置 (例如报文尾部预留的16字节)，
+// 数据不经过任何中间缓冲区。IV为空或总长度超过上限时返回false
+inline bool sm4GcmEncryptIov(const Sm4GcmKey& key, const uint8_t* iv, size_t ivLen,
+    const Sm4Iovec* aad, size_t aadCount, const Sm4Iovec* data, size_t count, uint8_t tag[16]) {
+    Sm4Gcm gcm;
+    if (!gcm.init(key, iv, ivLen)) {
+        return false;
+    }
+    for (size_t i = 0; i < aadCount; i++) {
+        gcm.update_aad((const uint8_t*)aad[i].iov_base, aad[i].iov_len);
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint8_t* p = (uint8_t*)data[i].iov_base;
+        if (!gcm.update(p, p, data[i].iov_len)) {
+            return false;
+        }
+    }
+    return gcm.finalize(tag);
+}
+
+// 原地解密并校验标签。只读一遍数据；标签不符时把已解密的各段清零后返回false，
+// 不会把未经认证的明文留给调用者
+inline bool sm4GcmDecryptIov(const Sm4GcmKey& key, const uint8_t* iv, size_t ivLen,
+    const Sm4Iovec* aad, size_t aadCount, const Sm4Iovec* data, size_t count, const uint8_t* tag, size_t tagLen) {
+    Sm4Gcm gcm;
+    bool ok = gcm.init(key, iv, ivLen, SM4_GCM_DECRYPT);
+    for (size_t i = 0; ok && i < aadCount; i++) {
+        gcm.update_aad((const uint8_t*)aad[i].iov_base, aad[i].iov_len);
+    }
+    for (size_t i = 0; ok && i < count; i++) {
+        uint8_t* p = (uint8_t*)data[i].iov_base;
+        ok = gcm.update(p, p, data[i].iov_len);
+    }
+    ok = ok && gcm.verify(tag, tagLen);
+    if (!ok) {
+        for (size_t i = 0; i < count; i++) {
+            sm4Wipe(data[i].iov_base, data[i].iov_len);
+        }
+    }
+    return ok;
+}
+
+// -------------------------- 多线程 --------------------------
+
+// 一条消息的密文按16字节对齐切成若干段，各段的CTR与GHASH互不依赖。
+// 第i段从0开始算出部分GHASH值T_i后，整条消息的GHASH为 S = (...((S_A·H^n_0 ^ T_0)·H^n_1 ^ T_1)...)，
+// n_i为第i段的分组数 (最后一段不足16字节的部分补零算一个分组)
+
+// 每段至少这么多字节：更短的段上创建线程的开销超过并行节省的时间
+const size_t kSm4GcmParallelMinSegment = (size_t)1 << 20;
+
+// a·b：有PCLMULQDQ时用无进位乘法，否则用逐位乘法，两者都是常数时间
+inline Gf128 gf128MulConst(const Gf128& a, const Gf128& b) {
+    static const bool clmul = cpuHas(CPU_PCLMUL);
+    if (clmul) {
+        return gf128FromM128(ghashClmulMul(gf128ToM128(a), gf128ToM128(b)));
+    }
+    return gf128Mul(a, b);
+}
+
+// H^n (n >= 1)，平方-乘法，乘法次数与n的位数成正比
+inline Gf128 ghashPow(const GhashKey& H, uint64_t n) {
+    Gf128 result = H.H;
+    Gf128 base = H.H;
+    n--;
+    while (n > 0) {
+        if (n & 1) {
+            result = gf128MulConst(result, base);
+        }
+        base = gf128MulConst(base, base);
+        n >>= 1;
+    }
+    return result;
+}
+
+// 把后面一段的部分GHASH值T并入S：S = S·H^n ^ T，Hn为预先算好的H^n
+inline void ghashCombine(Gf128& S, const Gf128& Hn, const Gf128& T) {
+    S = gf128MulConst(S, Hn);
+    S.hi ^= T.hi;
+    S.lo ^= T.lo;
+}
+
+// 处理从第blockOffset个分组开始的一段，T为这一段单独的GHASH值 (从0开始)。
+// ctr1为J0 + 1；除最后一段外len须为16的倍数
+inline void sm4GcmSegment(const Sm4GcmKey& key, const uint8_t ctr1[16], uint64_t blockOffset,
+    const uint8_t* in, uint8_t* out, size_t len, bool decrypt, Gf128& T) {
+    uint8_t ctr[16];
+    memcpy(ctr, ctr1, 16);
+    sm4CounterAdd(ctr, blockOffset, SM4_CTR_INC32);
+    T = { 0, 0 };
+    sm4GcmCrypt(key.key.enc, key.H, ctr, T, in, out, len, decrypt);
+}
+
+// 按顺序合并各段的部分GHASH值 (除最后一段外每段segBlocks个分组)，S为之前的累加值 (一般为AAD的GHASH)，
+// 并入长度分组后得到标签。除最后一段外各段长度相同，H^n只需算两次
+inline void sm4GcmCombineTag(const Sm4GcmKey& key, const uint8_t J0[16], Gf128 S, const Gf128* partial, size_t parts,
+    uint64_t segBlocks, uint64_t aadLen, uint64_t len, uint8_t tag[16]) {
+    if (len > 0) {
+        uint64_t blocks = (len + 15) / 16;
+        Gf128 Hseg = ghashPow(key.H, segBlocks);
+        uint64_t lastBlocks = blocks - (parts - 1) * segBlocks;
+        Gf128 Hlast = (lastBlocks == segBlocks) ? Hseg : ghashPow(key.H, lastBlocks);
+        for (size_t p = 0; p < parts; p++) {
+            ghashCombine(S, p + 1 < parts ? Hseg : Hlast, partial[p]);
+        }
+    }
+    ghashLengths(S, key.H, aadLen, len);
+    uint8_t ekJ0[16], s[16];
+    sm4_encrypt_blocks(key.key, J0, ekJ0, 1);
+    gf128Store(s, S);
+    xorBlock16(tag, ekJ0, s);
+}
+
+// 把整条消息平均分给至多threads个线程 (当前线程处理第一段)，每段不短于kSm4GcmParallelMinSegment，
+// 只有一段时不创建线程。合并各段的GHASH值后得到标签，结果与单线程逐位相同。tagOut非空时输出标签 (加密)，否则与tagIn常数时间比较 (解密)
+inline bool sm4GcmParallel(const Sm4GcmKey& key, const uint8_t* iv, size_t ivLen, const uint8_t* aad, size_t aadLen,
+    const uint8_t* in, uint8_t* out, size_t len, bool decrypt, unsigned threads,
+    uint8_t* tagOut, const uint8_t* tagIn, size_t tagLen) {
+    if (ivLen == 0 || len > kSm4GcmMaxText) {
+        return false;
+    }
+    uint8_t J0[16], ctr1[16];
+    sm4GcmJ0(key.H, iv, ivLen, J0);
+    memcpy(ctr1, J0, 16);
+    sm4CounterAdd(ctr1, 1, SM4_CTR_INC32);
+
+    Gf128 S = { 0, 0 };
+    ghashUpdate(S, key.H, aad, aadLen);
+
+    // 每段的分组数相同，最后一段可能较短
+    uint64_t blocks = (len + 15) / 16;
+    uint64_t maxParts = std::max<uint64_t>(1, len / kSm4GcmParallelMinSegment);
+    uint64_t parts = std::max<uint64_t>(1, std::min<uint64_t>(std::min<uint64_t>(threads, blocks), maxParts));
+    uint64_t segBlocks = std::max<uint64_t>(1, (blocks + parts - 1) / parts);
+    parts = std::max<uint64_t>(1, (blocks + segBlocks - 1) / segBlocks);
+    size_t segLen = (size_t)(segBlocks * 16);
+
+    std::vector<Gf128> partial((size_t)parts);
+    std::vector<std::thread> workers;
+    for (size_t p = 1; p < parts; p++) {
+        size_t off = p * segLen;
+        workers.emplace_back(sm4GcmSegment, std::cref(key), ctr1, (uint64_t)p * segBlocks, in + off, out + off,
+            std::min(segLen, len - off), decrypt, std::ref(partial[p]));
+    }
+    sm4GcmSegment(key, ctr1, 0, in, out, std::min(segLen, len), decrypt, partial[0]);
+    for (std::thread& w : workers) {
+        w.join();
+    }
+
+    uint8_t tag[16];
+    sm4GcmCombineTag(key, J0, S, partial.data(), (size_t)parts, segBlocks, aadLen, len, tag);
+    if (tagOut != nullptr) {
+        memcpy(tagOut, tag, 16);
+        return true;
+    }
+    if (tagLen < 12 || tagLen > 16 || !sm4GcmTagEqual(tag, tagIn, tagLen)) {
+        sm4Wipe(out, len);
+        return false;
+    }
+    return true;
+}
+
+inline bool sm4GcmEncryptParallel(const Sm4GcmKey& key, const uint8_t* iv, size_t ivLen, const uint8_t* aad, size_t aadLen,
+    const uint8_t* in, uint8_t* out, size_t len, uint8_t tag[16], unsigned threads) {
+    return sm4GcmParallel(key, iv, ivLen, aad, aadLen, in, out, len, false, threads, tag, nullptr, 0);
+}
+
+// 解密只读一遍数据；标签不符时把out清零后返回false
+inline bool sm4GcmDecryptParallel(const Sm4GcmKey& key, const uint8_t* iv, size_t ivLen, const uint8_t* aad, size_t aadLen,
+    const uint8_t* in, uint8_t* out, size_t len, const uint8_t* tag, size_t tagLen, unsigned threads) {
+    return sm4GcmParallel(key, iv, ivLen, aad, aadLen, in, out, len, true, threads, nullptr, tag, tagLen);
+}
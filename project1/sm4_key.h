@@ -0,0 +1,550 @@
+#pragma once
+// SM4密钥上下文与轮密钥缓存：
+// Sm4Key一次扩展，同时保存加密/解密轮密钥；
+// Sm4KeyCache按密钥指纹分片做LRU缓存，多租户服务不必每个请求都重新跑32步密钥扩展；
+// sm4_expand_keys把多个密钥放进SIMD寄存器的不同通道同时扩展，用于批量轮换会话密钥
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "sm4.h"
+#include "sm4_lanes.h"
+
+// -------------------------- 密钥扩展 --------------------------
+
+// 常数时间的标量密钥扩展：S盒用位切片电路计算，不按密钥查表
+inline void keyExpansionBitslice(const uint8_t* key, uint32_t rk[32]) {
+    uint32_t K[4];
+    for (int i = 0; i < 4; i++) {
+        K[i] = load32BE(key + 4 * i) ^ FK[i];
+    }
+
+    for (int i = 0; i < 32; i++) {
+        uint32_t s = sm4SboxWordBitslice(K[(i + 1) % 4] ^ K[(i + 2) % 4] ^ K[(i + 3) % 4] ^ CK[i]);
+        K[i % 4] ^= s ^ rotl(s, 13) ^ rotl(s, 23);
+        rk[i] = K[i % 4];
+    }
+}
+
+typedef void (*Sm4ExpandKeyFunc)(const uint8_t* key, uint32_t rk[32]);
+
+struct Sm4KeyScheduleKernel {
+    const char* name;
+    uint32_t required;
+    Sm4ExpandKeyFunc expand_key;
+};
+
+// GFNI / AESNI 的S盒指令，否则用位切片电路。
+// 三者都不依赖密钥查表，与SM4_CONSTANT_TIME策略无关
+inline constexpr Sm4KeyScheduleKernel kSm4KeyScheduleKernels[] = {
+    { "gfni", CPU_GFNI, keyExpansionGFNI },
+    { "aesni", CPU_AESNI | CPU_SSSE3, keyExpansionAESNI },
+    { "bitslice", 0, keyExpansionBitslice },
+};
+
+// 密钥扩展自检用的密钥数 (16的倍数，批量内核每组都是满的)，第0个为标准数据的密钥
+const size_t kSm4KeySelfTestKeys = 32;
+
+struct Sm4KeySelfTestData {
+    uint8_t keys[kSm4KeySelfTestKeys * 16];
+    uint32_t rk[kSm4KeySelfTestKeys][32];   // keyExpansionBasic的结果
+};
+
+inline void sm4KeySelfTestInit(Sm4KeySelfTestData& d) {
+    uint64_t seed = 0x534D342D4B455953ull;
+    selfTestFill(d.keys, sizeof(d.keys), seed);
+    memcpy(d.keys, kSm4TestKey, 16);
+    for (size_t i = 0; i < kSm4KeySelfTestKeys; i++) {
+        keyExpansionBasic(d.keys + 16 * i, d.rk[i]);
+    }
+}
+
+inline std::vector<KernelSelfTest> sm4KeyScheduleRunSelfTest() {
+    Sm4KeySelfTestData d;
+    sm4KeySelfTestInit(d);
+    std::vector<KernelSelfTest> results;
+    for (const Sm4KeyScheduleKernel& k : kSm4KeyScheduleKernels) {
+        bool supported = cpuHas(k.required);
+        bool passed = supported;
+        for (size_t i = 0; passed && i < kSm4KeySelfTestKeys; i++) {
+            uint32_t rk[32];
+            k.expand_key(d.keys + 16 * i, rk);
+            passed = memcmp(rk, d.rk[i], sizeof(rk)) == 0;
+        }
+        results.push_back({ k.name, supported, passed });
+    }
+    return results;
+}
+
+// 自检结果，顺序与kSm4KeyScheduleKernels相同
+inline const std::vector<KernelSelfTest>& sm4KeyScheduleSelfTestResults() {
+    static const std::vector<KernelSelfTest> results = sm4KeyScheduleRunSelfTest();
+    return results;
+}
+
+// 取表中第一个CPU支持且通过自检的实现
+inline const Sm4KeyScheduleKernel* sm4SelectKeyScheduleKernel() {
+    const std::vector<KernelSelfTest>& results = sm4KeyScheduleSelfTestResults();
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].passed) {
+            return &kSm4KeyScheduleKernels[i];
+        }
+    }
+    return &kSm4KeyScheduleKernels[2];
+}
+
+inline const Sm4KeyScheduleKernel* const g_sm4KeyScheduleKernel = sm4SelectKeyScheduleKernel();
+
+inline void sm4ExpandKey(const uint8_t key[16], uint32_t rk[32]) {
+    g_sm4KeyScheduleKernel->expand_key(key, rk);
+}
+
+// -------------------------- 密钥上下文 --------------------------
+
+// 清除密钥材料 (volatile写入，避免被优化掉)
+inline void sm4Wipe(void* p, size_t n) {
+    volatile uint8_t* v = static_cast<volatile uint8_t*>(p);
+    for (size_t i = 0; i < n; i++) {
+        v[i] = 0;
+    }
+}
+
+// 64字节对齐，轮密钥起始于缓存行边界
+struct alignas(64) Sm4Key {
+    uint32_t enc[32];           // 加密轮密钥 rk0 ... rk31
+    uint32_t dec[32];           // 解密轮密钥 rk31 ... rk0
+
+    Sm4Key() {
+        memset(this, 0, sizeof(*this));
+    }
+
+    explicit Sm4Key(const uint8_t key[16]) {
+        set(key);
+    }
+
+    Sm4Key(const Sm4Key&) = default;
+    Sm4Key& operator=(const Sm4Key&) = default;
+
+    ~Sm4Key() {
+        wipe();
+    }
+
+    void set(const uint8_t key[16]) {
+        uint32_t rk[32];
+        sm4ExpandKey(key, rk);
+        setRoundKeys(rk);
+        sm4Wipe(rk, sizeof(rk));
+    }
+
+    // 由已扩展好的加密轮密钥填写解密轮密钥
+    void setRoundKeys(const uint32_t rk[32]) {
+        memcpy(enc, rk, sizeof(enc));
+        sm4ReverseRoundKeys(enc, dec);
+    }
+
+    void wipe() {
+        sm4Wipe(this, sizeof(*this));
+    }
+};
+
+inline void sm4_encrypt_blocks(const Sm4Key& key, const uint8_t* in, uint8_t* out, size_t nblocks) {
+    g_sm4Kernel->encrypt_blocks(key.enc, in, out, nblocks);
+}
+
+inline void sm4_decrypt_blocks(const Sm4Key& key, const uint8_t* in, uint8_t* out, size_t nblocks) {
+    g_sm4Kernel->encrypt_blocks(key.dec, in, out, nblocks);
+}
+
+// -------------------------- 批量密钥扩展 --------------------------
+
+// 密钥扩展与加密的轮函数结构相同，只是线性变换换成L'(s) = s ^ rotl(s, 13) ^ rotl(s, 23)，
+// 轮密钥换成常数CK[i]。W个密钥按分组的方式装入寄存器并转置后，每个32位通道扩展一个密钥，
+// 第i轮的结果寄存器恰好就是sm4_lanes.h中rkLanes的第i行 (通道与密钥的对应关系同sm4LaneWord)
+
+CPU_TARGET("sse2")
+inline __m128i linearKeySSE2(__m128i s) {
+    __m128i r13 = _mm_or_si128(_mm_slli_epi32(s, 13), _mm_srli_epi32(s, 19));
+    __m128i r23 = _mm_or_si128(_mm_slli_epi32(s, 23), _mm_srli_epi32(s, 9));
+    return _mm_xor_si128(_mm_xor_si128(s, r13), r23);
+}
+
+CPU_TARGET("avx2")
+inline __m256i linearKeyAVX2(__m256i s) {
+    __m256i r13 = _mm256_or_si256(_mm256_slli_epi32(s, 13), _mm256_srli_epi32(s, 19));
+    __m256i r23 = _mm256_or_si256(_mm256_slli_epi32(s, 23), _mm256_srli_epi32(s, 9));
+    return _mm256_xor_si256(_mm256_xor_si256(s, r13), r23);
+}
+
+CPU_TARGET("avx512f")
+inline __m512i linearKeyAVX512(__m512i s) {
+    return _mm512_ternarylogic_epi32(s, _mm512_rol_epi32(s, 13), _mm512_rol_epi32(s, 23), 0x96);
+}
+
+// 常数时间的标量版本：逐个密钥用位切片电路扩展后写入对应通道
+inline void sm4ExpandKeysBitslice4(const uint8_t* keys, uint32_t* rkLanes) {
+    for (size_t b = 0; b < 4; b++) {
+        uint32_t rk[32];
+        keyExpansionBitslice(keys + 16 * b, rk);
+        sm4SetLaneKey(rkLanes, 4, b, rk);
+    }
+}
+
+CPU_TARGET("ssse3,aes")
+inline void sm4ExpandKeysAESNI4(const uint8_t* keys, uint32_t* rkLanes) {
+    __m128i K0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(keys + 0)), kBswap32);
+    __m128i K1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(keys + 16)), kBswap32);
+    __m128i K2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(keys + 32)), kBswap32);
+    __m128i K3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(keys + 48)), kBswap32);
+    transpose4x4(K0, K1, K2, K3);
+    K0 = _mm_xor_si128(K0, _mm_set1_epi32((int)FK[0]));
+    K1 = _mm_xor_si128(K1, _mm_set1_epi32((int)FK[1]));
+    K2 = _mm_xor_si128(K2, _mm_set1_epi32((int)FK[2]));
+    K3 = _mm_xor_si128(K3, _mm_set1_epi32((int)FK[3]));
+
+    __m128i* rk = (__m128i*)rkLanes;
+    for (int i = 0; i < 32; i += 4) {
+        K0 = _mm_xor_si128(K0, linearKeySSE2(sboxAESNI(_mm_xor_si128(_mm_xor_si128(K1, K2), _mm_xor_si128(K3, _mm_set1_epi32((int)CK[i]))))));
+        _mm_storeu_si128(rk + i, K0);
+        K1 = _mm_xor_si128(K1, linearKeySSE2(sboxAESNI(_mm_xor_si128(_mm_xor_si128(K2, K3), _mm_xor_si128(K0, _mm_set1_epi32((int)CK[i + 1]))))));
+        _mm_storeu_si128(rk + i + 1, K1);
+        K2 = _mm_xor_si128(K2, linearKeySSE2(sboxAESNI(_mm_xor_si128(_mm_xor_si128(K3, K0), _mm_xor_si128(K1, _mm_set1_epi32((int)CK[i + 2]))))));
+        _mm_storeu_si128(rk + i + 2, K2);
+        K3 = _mm_xor_si128(K3, linearKeySSE2(sboxAESNI(_mm_xor_si128(_mm_xor_si128(K0, K1), _mm_xor_si128(K2, _mm_set1_epi32((int)CK[i + 3]))))));
+        _mm_storeu_si128(rk + i + 3, K3);
+    }
+}
+
+CPU_TARGET("ssse3,gfni")
+inline void sm4ExpandKeysGFNI4(const uint8_t* keys, uint32_t* rkLanes) {
+    __m128i K0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(keys + 0)), kBswap32);
+    __m128i K1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(keys + 16)), kBswap32);
+    __m128i K2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(keys + 32)), kBswap32);
+    __m128i K3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(keys + 48)), kBswap32);
+    transpose4x4(K0, K1, K2, K3);
+    K0 = _mm_xor_si128(K0, _mm_set1_epi32((int)FK[0]));
+    K1 = _mm_xor_si128(K1, _mm_set1_epi32((int)FK[1]));
+    K2 = _mm_xor_si128(K2, _mm_set1_epi32((int)FK[2]));
+    K3 = _mm_xor_si128(K3, _mm_set1_epi32((int)FK[3]));
+
+    __m128i* rk = (__m128i*)rkLanes;
+    for (int i = 0; i < 32; i += 4) {
+        K0 = _mm_xor_si128(K0, linearKeySSE2(sboxGFNI(_mm_xor_si128(_mm_xor_si128(K1, K2), _mm_xor_si128(K3, _mm_set1_epi32((int)CK[i]))))));
+        _mm_storeu_si128(rk + i, K0);
+        K1 = _mm_xor_si128(K1, linearKeySSE2(sboxGFNI(_mm_xor_si128(_mm_xor_si128(K2, K3), _mm_xor_si128(K0, _mm_set1_epi32((int)CK[i + 1]))))));
+        _mm_storeu_si128(rk + i + 1, K1);
+        K2 = _mm_xor_si128(K2, linearKeySSE2(sboxGFNI(_mm_xor_si128(_mm_xor_si128(K3, K0), _mm_xor_si128(K1, _mm_set1_epi32((int)CK[i + 2]))))));
+        _mm_storeu_si128(rk + i + 2, K2);
+        K3 = _mm_xor_si128(K3, linearKeySSE2(sboxGFNI(_mm_xor_si128(_mm_xor_si128(K0, K1), _mm_xor_si128(K2, _mm_set1_epi32((int)CK[i + 3]))))));
+        _mm_storeu_si128(rk + i + 3, K3);
+    }
+}
+
+CPU_TARGET("avx2,aes")
+inline void sm4ExpandKeysAESNI8(const uint8_t* keys, uint32_t* rkLanes) {
+    const __m256i bswap = _mm256_broadcastsi128_si256(kBswap32);
+    __m256i K0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(keys + 0)), bswap);
+    __m256i K1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(keys + 32)), bswap);
+    __m256i K2 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(keys + 64)), bswap);
+    __m256i K3 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(keys + 96)), bswap);
+    transpose4x4_avx2(K0, K1, K2, K3);
+    K0 = _mm256_xor_si256(K0, _mm256_set1_epi32((int)FK[0]));
+    K1 = _mm256_xor_si256(K1, _mm256_set1_epi32((int)FK[1]));
+    K2 = _mm256_xor_si256(K2, _mm256_set1_epi32((int)FK[2]));
+    K3 = _mm256_xor_si256(K3, _mm256_set1_epi32((int)FK[3]));
+
+    __m256i* rk = (__m256i*)rkLanes;
+    for (int i = 0; i < 32; i += 4) {
+        K0 = _mm256_xor_si256(K0, linearKeyAVX2(sboxAESNI_AVX2(_mm256_xor_si256(_mm256_xor_si256(K1, K2), _mm256_xor_si256(K3, _mm256_set1_epi32((int)CK[i]))))));
+        _mm256_storeu_si256(rk + i, K0);
+        K1 = _mm256_xor_si256(K1, linearKeyAVX2(sboxAESNI_AVX2(_mm256_xor_si256(_mm256_xor_si256(K2, K3), _mm256_xor_si256(K0, _mm256_set1_epi32((int)CK[i + 1]))))));
+        _mm256_storeu_si256(rk + i + 1, K1);
+        K2 = _mm256_xor_si256(K2, linearKeyAVX2(sboxAESNI_AVX2(_mm256_xor_si256(_mm256_xor_si256(K3, K0), _mm256_xor_si256(K1, _mm256_set1_epi32((int)CK[i + 2]))))));
+        _mm256_storeu_si256(rk + i + 2, K2);
+        K3 = _mm256_xor_si256(K3, linearKeyAVX2(sboxAESNI_AVX2(_mm256_xor_si256(_mm256_xor_si256(K0, K1), _mm256_xor_si256(K2, _mm256_set1_epi32((int)CK[i + 3]))))));
+        _mm256_storeu_si256(rk + i + 3, K3);
+    }
+}
+
+CPU_TARGET("avx2,gfni")
+inline void sm4ExpandKeysGFNI8(const uint8_t* keys, uint32_t* rkLanes) {
+    const __m256i bswap = _mm256_broadcastsi128_si256(kBswap32);
+    __m256i K0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(keys + 0)), bswap);
+    __m256i K1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(keys + 32)), bswap);
+    __m256i K2 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(keys + 64)), bswap);
+    __m256i K3 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(keys + 96)), bswap);
+    transpose4x4_avx2(K0, K1, K2, K3);
+    K0 = _mm256_xor_si256(K0, _mm256_set1_epi32((int)FK[0]));
+    K1 = _mm256_xor_si256(K1, _mm256_set1_epi32((int)FK[1]));
+    K2 = _mm256_xor_si256(K2, _mm256_set1_epi32((int)FK[2]));
+    K3 = _mm256_xor_si256(K3, _mm256_set1_epi32((int)FK[3]));
+
+    __m256i* rk = (__m256i*)rkLanes;
+    for (int i = 0; i < 32; i += 4) {
+        K0 = _mm256_xor_si256(K0, linearKeyAVX2(sboxGFNI_AVX2(_mm256_xor_si256(_mm256_xor_si256(K1, K2), _mm256_xor_si256(K3, _mm256_set1_epi32((int)CK[i]))))));
+        _mm256_storeu_si256(rk + i, K0);
+        K1 = _mm256_xor_si256(K1, linearKeyAVX2(sboxGFNI_AVX2(_mm256_xor_si256(_mm256_xor_si256(K2, K3), _mm256_xor_si256(K0, _mm256_set1_epi32((int)CK[i + 1]))))));
+        _mm256_storeu_si256(rk + i + 1, K1);
+        K2 = _mm256_xor_si256(K2, linearKeyAVX2(sboxGFNI_AVX2(_mm256_xor_si256(_mm256_xor_si256(K3, K0), _mm256_xor_si256(K1, _mm256_set1_epi32((int)CK[i + 2]))))));
+        _mm256_storeu_si256(rk + i + 2, K2);
+        K3 = _mm256_xor_si256(K3, linearKeyAVX2(sboxGFNI_AVX2(_mm256_xor_si256(_mm256_xor_si256(K0, K1), _mm256_xor_si256(K2, _mm256_set1_epi32((int)CK[i + 3]))))));
+        _mm256_storeu_si256(rk + i + 3, K3);
+    }
+}
+
+CPU_TARGET("avx512f,avx512bw,gfni")
+inline void sm4ExpandKeysGFNI16(const uint8_t* keys, uint32_t* rkLanes) {
+    const __m512i bswap = _mm512_broadcast_i32x4(kBswap32);
+    __m512i K0 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(keys + 0)), bswap);
+    __m512i K1 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(keys + 64)), bswap);
+    __m512i K2 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(keys + 128)), bswap);
+    __m512i K3 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(keys + 192)), bswap);
+    transpose4x4_avx512(K0, K1, K2, K3);
+    K0 = _mm512_xor_si512(K0, _mm512_set1_epi32((int)FK[0]));
+    K1 = _mm512_xor_si512(K1, _mm512_set1_epi32((int)FK[1]));
+    K2 = _mm512_xor_si512(K2, _mm512_set1_epi32((int)FK[2]));
+    K3 = _mm512_xor_si512(K3, _mm512_set1_epi32((int)FK[3]));
+
+    for (int i = 0; i < 32; i += 4) {
+        K0 = _mm512_xor_si512(K0, linearKeyAVX512(sboxGFNI_AVX512(_mm512_xor_si512(_mm512_ternarylogic_epi32(K1, K2, K3, 0x96), _mm512_set1_epi32((int)CK[i])))));
+        _mm512_storeu_si512((void*)(rkLanes + 16 * i), K0);
+        K1 = _mm512_xor_si512(K1, linearKeyAVX512(sboxGFNI_AVX512(_mm512_xor_si512(_mm512_ternarylogic_epi32(K2, K3, K0, 0x96), _mm512_set1_epi32((int)CK[i + 1])))));
+        _mm512_storeu_si512((void*)(rkLanes + 16 * (i + 1)), K1);
+        K2 = _mm512_xor_si512(K2, linearKeyAVX512(sboxGFNI_AVX512(_mm512_xor_si512(_mm512_ternarylogic_epi32(K3, K0, K1, 0x96), _mm512_set1_epi32((int)CK[i + 2])))));
+        _mm512_storeu_si512((void*)(rkLanes + 16 * (i + 2)), K2);
+        K3 = _mm512_xor_si512(K3, linearKeyAVX512(sboxGFNI_AVX512(_mm512_xor_si512(_mm512_ternarylogic_epi32(K0, K1, K2, 0x96), _mm512_set1_epi32((int)CK[i + 3])))));
+        _mm512_storeu_si512((void*)(rkLanes + 16 * (i + 3)), K3);
+    }
+}
+
+// 扩展恰好lanes个连续存放的16字节密钥，结果按rkLanes[32][lanes]排列
+typedef void (*Sm4ExpandKeysFunc)(const uint8_t* keys, uint32_t* rkLanes);
+
+struct Sm4KeyExpandKernel {
+    const char* name;               // 与kSm4LaneKernels中同一指令集的名字相同
+    uint32_t required;
+    size_t lanes;
+    Sm4ExpandKeysFunc expand_keys;
+};
+
+// 都不依赖密钥查表，不需要区分常数时间策略
+inline constexpr Sm4KeyExpandKernel kSm4KeyExpandKernels[] = {
+    { "gfni-avx512", CPU_GFNI | CPU_AVX512F | CPU_AVX512BW, 16, sm4ExpandKeysGFNI16 },
+    { "gfni-avx2", CPU_GFNI | CPU_AVX2, 8, sm4ExpandKeysGFNI8 },
+    { "aesni-avx2", CPU_AESNI | CPU_AVX2, 8, sm4ExpandKeysAESNI8 },
+    { "gfni", CPU_GFNI | CPU_SSSE3, 4, sm4ExpandKeysGFNI4 },
+    { "aesni", CPU_AESNI | CPU_SSSE3, 4, sm4ExpandKeysAESNI4 },
+    { "bitslice-word", 0, 4, sm4ExpandKeysBitslice4 },
+};
+
+inline const Sm4KeyExpandKernel* sm4FindKeyExpandKernel(const char* name) {
+    for (const Sm4KeyExpandKernel& k : kSm4KeyExpandKernels) {
+        if (strcmp(k.name, name) == 0) {
+            return &k;
+        }
+    }
+    return nullptr;
+}
+
+inline std::vector<KernelSelfTest> sm4KeyExpandRunSelfTest() {
+    Sm4KeySelfTestData d;
+    sm4KeySelfTestInit(d);
+    std::vector<KernelSelfTest> results;
+    for (const Sm4KeyExpandKernel& k : kSm4KeyExpandKernels) {
+        bool supported = cpuHas(k.required);
+        bool passed = supported;
+        for (size_t i = 0; passed && i < kSm4KeySelfTestKeys; i += k.lanes) {
+            alignas(64) uint32_t rkLanes[32 * kSm4MaxLanes];
+            k.expand_keys(d.keys + 16 * i, rkLanes);
+            for (size_t b = 0; passed && b < k.lanes; b++) {
+                uint32_t rk[32];
+                sm4GetLaneKey(rkLanes, k.lanes, b, rk);
+                passed = memcmp(rk, d.rk[i + b], sizeof(rk)) == 0;
+            }
+        }
+        results.push_back({ k.name, supported, passed });
+    }
+    return results;
+}
+
+// 自检结果，顺序与kSm4KeyExpandKernels相同
+inline const std::vector<KernelSelfTest>& sm4KeyExpandSelfTestResults() {
+    static const std::vector<KernelSelfTest> results = sm4KeyExpandRunSelfTest();
+    return results;
+}
+
+inline bool sm4KeyExpandKernelUsable(const Sm4KeyExpandKernel& k) {
+    return sm4KeyExpandSelfTestResults()[&k - kSm4KeyExpandKernels].passed;
+}
+
+// SM4_KERNEL指定的指令集可用且通过自检时优先使用，否则取表中第一个可用的
+inline const Sm4KeyExpandKernel* sm4SelectKeyExpandKernel() {
+    const char* forced = getenv("SM4_KERNEL");
+    if (forced != nullptr && forced[0] != '\0') {
+        const Sm4KeyExpandKernel* k = sm4FindKeyExpandKernel(forced);
+        if (k != nullptr && sm4KeyExpandKernelUsable(*k)) {
+            return k;
+        }
+    }
+
+    for (const Sm4KeyExpandKernel& k : kSm4KeyExpandKernels) {
+        if (sm4KeyExpandKernelUsable(k)) {
+            return &k;
+        }
+    }
+    return sm4FindKeyExpandKernel("bitslice-word");
+}
+
+inline const Sm4KeyExpandKernel* const g_sm4KeyExpandKernel = sm4SelectKeyExpandKernel();
+
+// 用指定内核扩展n个密钥：每lanes个一组，最后不足一组的补零后扩展，只取用到的通道。
+// 每个通道的轮密钥直接取到enc中，再逆序得到dec
+inline void sm4ExpandKeysWith(const Sm4KeyExpandKernel& kernel, size_t n, const uint8_t* keys, Sm4Key* schedules) {
+    const size_t W = kernel.lanes;
+    alignas(64) uint32_t rkLanes[32 * kSm4MaxLanes];
+    alignas(64) uint8_t tail[16 * kSm4MaxLanes];
+    for (size_t i = 0; i < n; i += W) {
+        size_t m = std::min(W, n - i);
+        const uint8_t* src = keys + 16 * i;
+        if (m < W) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, src, 16 * m);
+            src = tail;
+        }
+        kernel.expand_keys(src, rkLanes);
+        for (size_t b = 0; b < m; b++) {
+            Sm4Key& key = schedules[i + b];
+            sm4GetLaneKey(rkLanes, W, b, key.enc);
+            sm4ReverseRoundKeys(key.enc, key.dec);
+        }
+    }
+    sm4Wipe(rkLanes, sizeof(rkLanes));
+    sm4Wipe(tail, sizeof(tail));
+}
+
+// 批量扩展n个密钥 (keys为连续的n * 16字节)，schedules[i]得到与Sm4Key(keys + 16 * i)相同的加密/解密轮密钥
+inline void sm4_expand_keys(size_t n, const uint8_t* keys, Sm4Key* schedules) {
+    sm4ExpandKeysWith(*g_sm4KeyExpandKernel, n, keys, schedules);
+}
+
+// -------------------------- 分片LRU缓存 --------------------------
+
+// 密钥指纹：带进程随机种子的64位混合哈希，只用于定位缓存项，
+// 命中后仍比较完整密钥，指纹碰撞不会返回错误的上下文
+inline uint64_t sm4KeyFingerprint(const uint8_t key[16], uint64_t seed) {
+    uint64_t a, b;
+    memcpy(&a, key, 8);
+    memcpy(&b, key + 8, 8);
+    uint64_t h = seed ^ (a * 0x9E3779B97F4A7C15ull);
+    h = (h ^ (h >> 31)) * 0xBF58476D1CE4E5B9ull;
+    h ^= b * 0xC2B2AE3D27D4EB4Full;
+    h = (h ^ (h >> 29)) * 0x94D049BB133111EBull;
+    return h ^ (h >> 32);
+}
+
+// 常数时间的16字节比较
+inline bool sm4KeyEqual(const uint8_t a[16], const uint8_t b[16]) {
+    return sm4ConstTimeEqual(a, b, 16);
+}
+
+class Sm4KeyCache {
+public:
+    // capacity为总容量，平均分到各分片；每个分片一把锁，不同分片的请求互不阻塞
+    explicit Sm4KeyCache(size_t capacity = 1024, size_t shardCount = 16)
+        : shards_(shardCount == 0 ? 1 : shardCount) {
+        perShard_ = (capacity + shards_.size() - 1) / shards_.size();
+        if (perShard_ == 0) {
+            perShard_ = 1;
+        }
+        std::random_device rd;
+        seed_ = ((uint64_t)rd() << 32) ^ rd();
+    }
+
+    Sm4KeyCache(const Sm4KeyCache&) = delete;
+    Sm4KeyCache& operator=(const Sm4KeyCache&) = delete;
+
+    // 返回key对应的上下文：命中时移到LRU队首，未命中时扩展并插入，超出容量则淘汰队尾。
+    // 返回的shared_ptr在项被淘汰后仍然有效
+    std::shared_ptr<const Sm4Key> get(const uint8_t key[16]) {
+        uint64_t fp = sm4KeyFingerprint(key, seed_);
+        Shard& shard = shards_[fp % shards_.size()];
+
+        std::lock_guard<std::mutex> lock(shard.mu);
+        auto it = shard.index.find(fp);
+        if (it != shard.index.end()) {
+            if (sm4KeyEqual(it->second->key, key)) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return it->second->ctx;
+            }
+            // 指纹碰撞：旧项让位给新密钥
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        std::shared_ptr<const Sm4Key> ctx = std::make_shared<Sm4Key>(key);
+        shard.lru.emplace_front();
+        Entry& e = shard.lru.front();
+        memcpy(e.key, key, 16);
+        e.fp = fp;
+        e.ctx = ctx;
+        shard.index[fp] = shard.lru.begin();
+
+        while (shard.lru.size() > perShard_) {
+            shard.index.erase(shard.lru.back().fp);
+            shard.lru.pop_back();
+        }
+        return ctx;
+    }
+
+    void clear() {
+        for (Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mu);
+            shard.index.clear();
+            shard.lru.clear();
+        }
+    }
+
+    size_t size() {
+        size_t n = 0;
+        for (Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mu);
+            n += shard.lru.size();
+        }
+        return n;
+    }
+
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry {
+        uint8_t key[16];
+        uint64_t fp;
+        std::shared_ptr<const Sm4Key> ctx;
+
+        ~Entry() {
+            sm4Wipe(key, sizeof(key));
+        }
+    };
+
+    struct Shard {
+        std::mutex mu;
+        std::list<Entry> lru;
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    };
+
+    std::vector<Shard> shards_;
+    size_t perShard_;
+    uint64_t seed_;
+    std::atomic<uint64_t> hits_{ 0 };
+    std::atomic<uint64_t> misses_{ 0 };
+};
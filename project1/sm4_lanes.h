@@ -0,0 +1,300 @@
+#pragma once
+// SM4多路内核 (每路独立轮密钥)：W个分组一起加密，第b个分组使用第b路的轮密钥。
+// 用于多个互不相关的流 (各自的密钥、IV) 并行推进，例如多流CBC加密、多缓冲任务调度
+//
+// 轮密钥布局rkLanes[32][W]：第i轮的W个32位字连续存放，按字切片寄存器中的位置排列，
+// 由sm4SetLaneKey写入，一次_mm512_loadu_si512即可取得16路的轮密钥
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "sm4.h"
+
+// 多路内核的最大路数
+const size_t kSm4MaxLanes = 16;
+
+// 分组按寄存器装入后在每个128位通道内做4x4转置，
+// 因此字切片寄存器中第4k+j个32位字来自第(W/4)*j+k个分组；这里做反向映射
+inline size_t sm4LaneWord(size_t lanes, size_t slot) {
+    size_t q = lanes / 4;
+    return 4 * (slot % q) + slot / q;
+}
+
+// 把一组轮密钥写入第slot路
+inline void sm4SetLaneKey(uint32_t* rkLanes, size_t lanes, size_t slot, const uint32_t rk[32]) {
+    size_t w = sm4LaneWord(lanes, slot);
+    for (int i = 0; i < 32; i++) {
+        rkLanes[lanes * i + w] = rk[i];
+    }
+}
+
+// 取出第slot路的轮密钥
+inline void sm4GetLaneKey(const uint32_t* rkLanes, size_t lanes, size_t slot, uint32_t rk[32]) {
+    size_t w = sm4LaneWord(lanes, slot);
+    for (int i = 0; i < 32; i++) {
+        rk[i] = rkLanes[lanes * i + w];
+    }
+}
+
+// -------------------------- 标量版本 --------------------------
+
+// T-table的4路版本：逐路取出轮密钥后单块加密
+inline void sm4EncryptLanesTTable(const uint32_t* rkLanes, const uint8_t* in, uint8_t* out) {
+    for (size_t b = 0; b < 4; b++) {
+        uint32_t rk[32];
+        sm4GetLaneKey(rkLanes, 4, b, rk);
+        sm4EncryptTTable(in + 16 * b, rk, out + 16 * b);
+    }
+}
+
+// 常数时间的4路标量版本：S盒用位切片电路逐字计算，没有SIMD时的退路
+inline void sm4EncryptLanesBitsliceWord(const uint32_t* rkLanes, const uint8_t* in, uint8_t* out) {
+    for (size_t b = 0; b < 4; b++) {
+        uint32_t X[4];
+        for (int j = 0; j < 4; j++) {
+            X[j] = load32BE(in + 16 * b + 4 * j);
+        }
+        for (int i = 0; i < 32; i++) {
+            uint32_t s = sm4SboxWordBitslice(X[(i + 1) % 4] ^ X[(i + 2) % 4] ^ X[(i + 3) % 4] ^ rkLanes[4 * i + b]);
+            X[i % 4] ^= sm4L(s);
+        }
+        for (int j = 0; j < 4; j++) {
+            store32BE(out + 16 * b + 4 * j, X[3 - j]);
+        }
+    }
+}
+
+// -------------------------- SIMD版本 --------------------------
+
+// 与sm4EncryptAESNI4相同，只是每轮从rkLanes装入4路各自的轮密钥
+CPU_TARGET("ssse3,aes")
+inline void sm4EncryptLanesAESNI4(const uint32_t* rkLanes, const uint8_t* in, uint8_t* out) {
+    __m128i X0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 0)), kBswap32);
+    __m128i X1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 16)), kBswap32);
+    __m128i X2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 32)), kBswap32);
+    __m128i X3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 48)), kBswap32);
+    transpose4x4(X0, X1, X2, X3);
+
+    const __m128i* rk = (const __m128i*)rkLanes;
+    for (int i = 0; i < 32; i += 4) {
+        X0 = _mm_xor_si128(X0, T_aesni(_mm_xor_si128(_mm_xor_si128(X1, X2), _mm_xor_si128(X3, _mm_loadu_si128(rk + i)))));
+        X1 = _mm_xor_si128(X1, T_aesni(_mm_xor_si128(_mm_xor_si128(X2, X3), _mm_xor_si128(X0, _mm_loadu_si128(rk + i + 1)))));
+        X2 = _mm_xor_si128(X2, T_aesni(_mm_xor_si128(_mm_xor_si128(X3, X0), _mm_xor_si128(X1, _mm_loadu_si128(rk + i + 2)))));
+        X3 = _mm_xor_si128(X3, T_aesni(_mm_xor_si128(_mm_xor_si128(X0, X1), _mm_xor_si128(X2, _mm_loadu_si128(rk + i + 3)))));
+    }
+
+    transpose4x4(X3, X2, X1, X0);
+    _mm_storeu_si128((__m128i*)(out + 0), _mm_shuffle_epi8(X3, kBswap32));
+    _mm_storeu_si128((__m128i*)(out + 16), _mm_shuffle_epi8(X2, kBswap32));
+    _mm_storeu_si128((__m128i*)(out + 32), _mm_shuffle_epi8(X1, kBswap32));
+    _mm_storeu_si128((__m128i*)(out + 48), _mm_shuffle_epi8(X0, kBswap32));
+}
+
+CPU_TARGET("ssse3,gfni")
+inline void sm4EncryptLanesGFNI4(const uint32_t* rkLanes, const uint8_t* in, uint8_t* out) {
+    __m128i X0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 0)), kBswap32);
+    __m128i X1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 16)), kBswap32);
+    __m128i X2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 32)), kBswap32);
+    __m128i X3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 48)), kBswap32);
+    transpose4x4(X0, X1, X2, X3);
+
+    const __m128i* rk = (const __m128i*)rkLanes;
+    for (int i = 0; i < 32; i += 4) {
+        X0 = _mm_xor_si128(X0, T_gfni(_mm_xor_si128(_mm_xor_si128(X1, X2), _mm_xor_si128(X3, _mm_loadu_si128(rk + i)))));
+        X1 = _mm_xor_si128(X1, T_gfni(_mm_xor_si128(_mm_xor_si128(X2, X3), _mm_xor_si128(X0, _mm_loadu_si128(rk + i + 1)))));
+        X2 = _mm_xor_si128(X2, T_gfni(_mm_xor_si128(_mm_xor_si128(X3, X0), _mm_xor_si128(X1, _mm_loadu_si128(rk + i + 2)))));
+        X3 = _mm_xor_si128(X3, T_gfni(_mm_xor_si128(_mm_xor_si128(X0, X1), _mm_xor_si128(X2, _mm_loadu_si128(rk + i + 3)))));
+    }
+
+    transpose4x4(X3, X2, X1, X0);
+    _mm_storeu_si128((__m128i*)(out + 0), _mm_shuffle_epi8(X3, kBswap32));
+    _mm_storeu_si128((__m128i*)(out + 16), _mm_shuffle_epi8(X2, kBswap32));
+    _mm_storeu_si128((__m128i*)(out + 32), _mm_shuffle_epi8(X1, kBswap32));
+    _mm_storeu_si128((__m128i*)(out + 48), _mm_shuffle_epi8(X0, kBswap32));
+}
+
+CPU_TARGET("avx2,aes")
+inline void sm4EncryptLanesAESNI8(const uint32_t* rkLanes, const uint8_t* in, uint8_t* out) {
+    const __m256i bswap = _mm256_broadcastsi128_si256(kBswap32);
+    __m256i X0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 0)), bswap);
+    __m256i X1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 32)), bswap);
+    __m256i X2 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 64)), bswap);
+    __m256i X3 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 96)), bswap);
+    transpose4x4_avx2(X0, X1, X2, X3);
+
+    const __m256i* rk = (const __m256i*)rkLanes;
+    for (int i = 0; i < 32; i += 4) {
+        X0 = _mm256_xor_si256(X0, T_aesni_avx2(_mm256_xor_si256(_mm256_xor_si256(X1, X2), _mm256_xor_si256(X3, _mm256_loadu_si256(rk + i)))));
+        X1 = _mm256_xor_si256(X1, T_aesni_avx2(_mm256_xor_si256(_mm256_xor_si256(X2, X3), _mm256_xor_si256(X0, _mm256_loadu_si256(rk + i + 1)))));
+        X2 = _mm256_xor_si256(X2, T_aesni_avx2(_mm256_xor_si256(_mm256_xor_si256(X3, X0), _mm256_xor_si256(X1, _mm256_loadu_si256(rk + i + 2)))));
+        X3 = _mm256_xor_si256(X3, T_aesni_avx2(_mm256_xor_si256(_mm256_xor_si256(X0, X1), _mm256_xor_si256(X2, _mm256_loadu_si256(rk + i + 3)))));
+    }
+
+    transpose4x4_avx2(X3, X2, X1, X0);
+    _mm256_storeu_si256((__m256i*)(out + 0), _mm256_shuffle_epi8(X3, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 32), _mm256_shuffle_epi8(X2, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 64), _mm256_shuffle_epi8(X1, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 96), _mm256_shuffle_epi8(X0, bswap));
+}
+
+CPU_TARGET("avx2,gfni")
+inline void sm4EncryptLanesGFNI8(const uint32_t* rkLanes, const uint8_t* in, uint8_t* out) {
+    const __m256i bswap = _mm256_broadcastsi128_si256(kBswap32);
+    __m256i X0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 0)), bswap);
+    __m256i X1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 32)), bswap);
+    __m256i X2 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 64)), bswap);
+    __m256i X3 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(in + 96)), bswap);
+    transpose4x4_avx2(X0, X1, X2, X3);
+
+    const __m256i* rk = (const __m256i*)rkLanes;
+    for (int i = 0; i < 32; i += 4) {
+        X0 = _mm256_xor_si256(X0, T_gfni_avx2(_mm256_xor_si256(_mm256_xor_si256(X1, X2), _mm256_xor_si256(X3, _mm256_loadu_si256(rk + i)))));
+        X1 = _mm256_xor_si256(X1, T_gfni_avx2(_mm256_xor_si256(_mm256_xor_si256(X2, X3), _mm256_xor_si256(X0, _mm256_loadu_si256(rk + i + 1)))));
+        X2 = _mm256_xor_si256(X2, T_gfni_avx2(_mm256_xor_si256(_mm256_xor_si256(X3, X0), _mm256_xor_si256(X1, _mm256_loadu_si256(rk + i + 2)))));
+        X3 = _mm256_xor_si256(X3, T_gfni_avx2(_mm256_xor_si256(_mm256_xor_si256(X0, X1), _mm256_xor_si256(X2, _mm256_loadu_si256(rk + i + 3)))));
+    }
+
+    transpose4x4_avx2(X3, X2, X1, X0);
+    _mm256_storeu_si256((__m256i*)(out + 0), _mm256_shuffle_epi8(X3, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 32), _mm256_shuffle_epi8(X2, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 64), _mm256_shuffle_epi8(X1, bswap));
+    _mm256_storeu_si256((__m256i*)(out + 96), _mm256_shuffle_epi8(X0, bswap));
+}
+
+CPU_TARGET("avx512f,avx512bw,gfni")
+inline void sm4EncryptLanesGFNI16(const uint32_t* rkLanes, const uint8_t* in, uint8_t* out) {
+    const __m512i bswap = _mm512_broadcast_i32x4(kBswap32);
+    __m512i X0 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(in + 0)), bswap);
+    __m512i X1 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(in + 64)), bswap);
+    __m512i X2 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(in + 128)), bswap);
+    __m512i X3 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(in + 192)), bswap);
+    transpose4x4_avx512(X0, X1, X2, X3);
+
+    for (int i = 0; i < 32; i += 4) {
+        X0 = _mm512_xor_si512(X0, T_gfni_avx512(_mm512_xor_si512(_mm512_ternarylogic_epi32(X1, X2, X3, 0x96), _mm512_loadu_si512((const void*)(rkLanes + 16 * i)))));
+        X1 = _mm512_xor_si512(X1, T_gfni_avx512(_mm512_xor_si512(_mm512_ternarylogic_epi32(X2, X3, X0, 0x96), _mm512_loadu_si512((const void*)(rkLanes + 16 * (i + 1))))));
+        X2 = _mm512_xor_si512(X2, T_gfni_avx512(_mm512_xor_si512(_mm512_ternarylogic_epi32(X3, X0, X1, 0x96), _mm512_loadu_si512((const void*)(rkLanes + 16 * (i + 2))))));
+        X3 = _mm512_xor_si512(X3, T_gfni_avx512(_mm512_xor_si512(_mm512_ternarylogic_epi32(X0, X1, X2, 0x96), _mm512_loadu_si512((const void*)(rkLanes + 16 * (i + 3))))));
+    }
+
+    transpose4x4_avx512(X3, X2, X1, X0);
+    _mm512_storeu_si512((void*)(out + 0), _mm512_shuffle_epi8(X3, bswap));
+    _mm512_storeu_si512((void*)(out + 64), _mm512_shuffle_epi8(X2, bswap));
+    _mm512_storeu_si512((void*)(out + 128), _mm512_shuffle_epi8(X1, bswap));
+    _mm512_storeu_si512((void*)(out + 192), _mm512_shuffle_epi8(X0, bswap));
+}
+
+// -------------------------- 运行时分派 --------------------------
+
+// 加密恰好lanes个分组，in与out可以相同
+typedef void (*Sm4LanesFunc)(const uint32_t* rkLanes, const uint8_t* in, uint8_t* out);
+
+struct Sm4LaneKernel {
+    const char* name;               // 与kSm4Kernels中同一实现的名字相同
+    uint32_t required;
+    bool constant_time;
+    size_t lanes;                   // 路数W：4、8或16
+    Sm4LanesFunc encrypt_lanes;
+};
+
+// 位切片内核一次需要64个分组且所有分组共用轮密钥，没有多路版本；
+// 常数时间策略下没有SIMD时退到逐字位切片的标量版本
+inline constexpr Sm4LaneKernel kSm4LaneKernels[] = {
+    { "gfni-avx512", CPU_GFNI | CPU_AVX512F | CPU_AVX512BW, true, 16, sm4EncryptLanesGFNI16 },
+    { "gfni-avx2", CPU_GFNI | CPU_AVX2, true, 8, sm4EncryptLanesGFNI8 },
+    { "aesni-avx2", CPU_AESNI | CPU_AVX2, true, 8, sm4EncryptLanesAESNI8 },
+    { "gfni", CPU_GFNI | CPU_SSSE3, true, 4, sm4EncryptLanesGFNI4 },
+    { "aesni", CPU_AESNI | CPU_SSSE3, true, 4, sm4EncryptLanesAESNI4 },
+    { "ttable", 0, false, 4, sm4EncryptLanesTTable },
+    { "bitslice-word", 0, true, 4, sm4EncryptLanesBitsliceWord },
+};
+
+inline const Sm4LaneKernel* sm4FindLaneKernel(const char* name) {
+    for (const Sm4LaneKernel& k : kSm4LaneKernels) {
+        if (strcmp(k.name, name) == 0) {
+            return &k;
+        }
+    }
+    return nullptr;
+}
+
+// 自检：每路一个随机密钥 (第0路为标准数据的密钥)，连续若干次调用各路输入不同，
+// 逐路与sm4EncryptBasic对照，可以发现通道与密钥对应错位的问题
+const size_t kSm4LaneSelfTestSteps = 16;
+
+inline bool sm4LaneSelfTestKernel(const Sm4LaneKernel& k) {
+    const size_t W = k.lanes;
+    uint64_t seed = 0x534D342D4C414E45ull;
+    uint32_t rk[kSm4MaxLanes][32];
+    alignas(64) uint32_t rkLanes[32 * kSm4MaxLanes];
+    for (size_t b = 0; b < W; b++) {
+        uint8_t key[16];
+        selfTestFill(key, 16, seed);
+        keyExpansionBasic(b == 0 ? kSm4TestKey : key, rk[b]);
+        sm4SetLaneKey(rkLanes, W, b, rk[b]);
+    }
+
+    alignas(64) uint8_t in[16 * kSm4MaxLanes], out[16 * kSm4MaxLanes], ref[16];
+    for (size_t step = 0; step < kSm4LaneSelfTestSteps; step++) {
+        selfTestFill(in, 16 * W, seed);
+        if (step == 0) {
+            memcpy(in, kSm4TestKey, 16);
+        }
+        k.encrypt_lanes(rkLanes, in, out);
+        for (size_t b = 0; b < W; b++) {
+            sm4EncryptBasic(in + 16 * b, rk[b], ref);
+            if (memcmp(out + 16 * b, ref, 16) != 0) {
+                return false;
+            }
+        }
+        if (step == 0 && memcmp(out, kSm4TestCipher, 16) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline std::vector<KernelSelfTest> sm4LaneRunSelfTest() {
+    std::vector<KernelSelfTest> results;
+    for (const Sm4LaneKernel& k : kSm4LaneKernels) {
+        bool supported = cpuHas(k.required);
+        results.push_back({ k.name, supported, supported && sm4LaneSelfTestKernel(k) });
+    }
+    return results;
+}
+
+// 自检结果，顺序与kSm4LaneKernels相同
+inline const std::vector<KernelSelfTest>& sm4LaneSelfTestResults() {
+    static const std::vector<KernelSelfTest> results = sm4LaneRunSelfTest();
+    return results;
+}
+
+inline bool sm4LaneKernelUsable(const Sm4LaneKernel& k) {
+    return sm4LaneSelfTestResults()[&k - kSm4LaneKernels].passed;
+}
+
+// 与sm4SelectKernel相同的规则；SM4_KERNEL指定的内核没有多路版本时直接自动选择
+// (不合法的取值已由sm4SelectKernel报告过)
+inline const Sm4LaneKernel* sm4SelectLaneKernel() {
+    bool ct = sm4ConstantTimePolicy();
+    const char* forced = getenv("SM4_KERNEL");
+    if (forced != nullptr && forced[0] != '\0') {
+        const Sm4LaneKernel* k = sm4FindLaneKernel(forced);
+        if (k != nullptr && sm4LaneKernelUsable(*k) && (!ct || k->constant_time)) {
+            return k;
+        }
+    }
+
+    for (const Sm4LaneKernel& k : kSm4LaneKernels) {
+        if (sm4LaneKernelUsable(k) && (!ct || k.constant_time)) {
+            return &k;
+        }
+    }
+    return sm4FindLaneKernel("bitslice-word");
+}
+
+inline const Sm4LaneKernel* const g_sm4LaneKernel = sm4SelectLaneKernel();
@@ -0,0 +1,296 @@
+#pragma once
+// 只做认证不加密的SM4-GMAC与SM4-CMAC。
+// GMAC就是明文为空的GCM：数据全部作为AAD，只经过GHASH，沿用Sm4GcmKey中预先算好的H的各次幂。
+// CMAC (NIST SP 800-38B) 是CBC-MAC加上对最后一个分组的子密钥处理，单条消息内完全串行；
+// 多条互不相关的消息放进多路内核的不同通道并行推进 (与多流CBC加密相同)
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "sm4.h"
+#include "sm4_key.h"
+#include "sm4_lanes.h"
+#include "sm4_gcm.h"
+
+// -------------------------- GMAC --------------------------
+
+// 流式GMAC：init后用update输入任意长度的数据片段，最后finalize取标签或verify校验。
+// 同一个Sm4GcmKey可供多个Sm4Gmac同时只读使用
+class Sm4Gmac {
+public:
+    // ivLen为0时返回false
+    bool init(const Sm4GcmKey& key, const uint8_t* iv, size_t ivLen) {
+        return gcm_.init(key, iv, ivLen);
+    }
+
+    bool update(const uint8_t* data, size_t len) {
+        return gcm_.update_aad(data, len);
+    }
+
+    bool finalize(uint8_t tag[16]) {
+        return gcm_.finalize(tag);
+    }
+
+    // 常数时间比较标签 (允许截断到12 ~ 16字节)
+    bool verify(const uint8_t* tag, size_t tagLen) {
+        uint8_t expected[16];
+        if (tagLen < 12 || tagLen > 16 || !gcm_.finalize(expected)) {
+            return false;
+        }
+        bool ok = sm4GcmTagEqual(expected, tag, tagLen);
+        sm4Wipe(expected, sizeof(expected));
+        return ok;
+    }
+
+private:
+    Sm4Gcm gcm_;
+};
+
+inline bool sm4Gmac(const Sm4GcmKey& key, const uint8_t* iv, size_t ivLen, const uint8_t* data, size_t len, uint8_t tag[16]) {
+    Sm4Gmac mac;
+    return mac.init(key, iv, ivLen) && mac.update(data, len) && mac.finalize(tag);
+}
+
+// -------------------------- CMAC子密钥 --------------------------
+
+// 按大端128位整数左移1位，移出的最高位以0x87反馈到最低字节 (与XTS的α方向相反)
+inline void cmacDouble(uint8_t out[16], const uint8_t in[16]) {
+    uint8_t carry = (uint8_t)(0 - (in[0] >> 7));
+    for (int i = 0; i < 15; i++) {
+        out[i] = (uint8_t)((in[i] << 1) | (in[i + 1] >> 7));
+    }
+    out[15] = (uint8_t)((in[15] << 1) ^ (carry & 0x87));
+}
+
+// 密钥上下文：L = E_K(0^128)，K1 = L·x，K2 = L·x^2，每个密钥只算一次
+struct Sm4CmacKey {
+    Sm4Key key;
+    uint8_t K1[16];     // 最后一个分组是完整分组时使用
+    uint8_t K2[16];     // 最后一个分组需要填充时使用
+
+    Sm4CmacKey() {
+        memset(K1, 0, sizeof(K1));
+        memset(K2, 0, sizeof(K2));
+    }
+
+    explicit Sm4CmacKey(const uint8_t key[16]) {
+        set(key);
+    }
+
+    ~Sm4CmacKey() {
+        sm4Wipe(K1, sizeof(K1));
+        sm4Wipe(K2, sizeof(K2));
+    }
+
+    void set(const uint8_t k[16]) {
+        key.set(k);
+        deriveSubkeys();
+    }
+
+    // 由已扩展好的轮密钥建立上下文
+    void setRoundKeys(const uint32_t rk[32]) {
+        key.setRoundKeys(rk);
+        deriveSubkeys();
+    }
+
+private:
+    void deriveSubkeys() {
+        uint8_t L[16] = { 0 };
+        sm4_encrypt_blocks(key, L, L, 1);
+        cmacDouble(K1, L);
+        cmacDouble(K2, K1);
+        sm4Wipe(L, sizeof(L));
+    }
+};
+
+// -------------------------- 流式CMAC --------------------------
+
+class Sm4Cmac;
+
+// 一次多流update中的一项：把data的len字节送入ctx
+struct Sm4CmacStream {
+    Sm4Cmac* ctx;
+    const uint8_t* data;
+    size_t len;
+};
+
+inline void sm4CmacUpdateStreamsWith(const Sm4LaneKernel& lk, Sm4CmacStream* streams, size_t count);
+
+// 流式CMAC。最后一个分组要用K1或K2处理，但只有在后面又来了数据时才能确定某个分组不是最后一个，
+// 因此buf_中总是留着最后1 ~ 16字节，其余分组进链：X = E_K(X ^ M_i)
+class Sm4Cmac {
+public:
+    Sm4Cmac() : key_(nullptr), kernel_(nullptr), bufLen_(0) {
+    }
+
+    ~Sm4Cmac() {
+        sm4Wipe(X_, sizeof(X_));
+        sm4Wipe(buf_, sizeof(buf_));
+    }
+
+    Sm4Cmac(const Sm4Cmac&) = delete;
+    Sm4Cmac& operator=(const Sm4Cmac&) = delete;
+
+    // kernel为空时使用分派选定的批量内核 (单流update每次只加密一个分组)
+    void init(const Sm4CmacKey& key, Sm4BlocksFunc kernel = nullptr) {
+        key_ = &key;
+        kernel_ = (kernel != nullptr) ? kernel : g_sm4Kernel->encrypt_blocks;
+        memset(X_, 0, sizeof(X_));
+        bufLen_ = 0;
+    }
+
+    // 连续多次调用的结果与一次输入拼接后的数据相同。未init时返回false
+    bool update(const uint8_t* data, size_t len) {
+        if (key_ == nullptr) {
+            return false;
+        }
+        size_t blocks = prepare(data, len);
+        for (size_t i = 0; i < blocks; i++) {
+            xorBlock16(X_, X_, block(data, i));
+            kernel_(key_->key.enc, X_, X_, 1);
+        }
+        keepTail(data, len, blocks);
+        return true;
+    }
+
+    // 输出16字节标签，上下文回到未init状态
+    bool finalize(uint8_t tag[16]) {
+        if (key_ == nullptr) {
+            return false;
+        }
+        // 完整的最后一个分组异或K1；否则补0x80 00 ... 后异或K2
+        uint8_t last[16];
+        if (bufLen_ == 16) {
+            xorBlock16(last, buf_, key_->K1);
+        }
+        else {
+            memset(buf_ + bufLen_, 0, 16 - bufLen_);
+            buf_[bufLen_] = 0x80;
+            xorBlock16(last, buf_, key_->K2);
+        }
+        xorBlock16(X_, X_, last);
+        kernel_(key_->key.enc, X_, tag, 1);
+        sm4Wipe(last, sizeof(last));
+        sm4Wipe(X_, sizeof(X_));
+        sm4Wipe(buf_, sizeof(buf_));
+        key_ = nullptr;
+        return true;
+    }
+
+    // 常数时间比较标签 (允许截断到8 ~ 16字节)
+    bool verify(const uint8_t* tag, size_t tagLen) {
+        uint8_t expected[16];
+        if (tagLen < 8 || tagLen > 16 || !finalize(expected)) {
+            return false;
+        }
+        bool ok = sm4ConstTimeEqual(expected, tag, tagLen);
+        sm4Wipe(expected, sizeof(expected));
+        return ok;
+    }
+
+private:
+    friend void sm4CmacUpdateStreamsWith(const Sm4LaneKernel& lk, Sm4CmacStream* streams, size_t count);
+
+    // 先补满buf_。之后还有数据时buf_中的分组不是最后一个，连同data中除最后1 ~ 16字节外的
+    // 完整分组一起进链；返回进链的分组数，data/len指向补满buf_之后的剩余部分
+    size_t prepare(const uint8_t*& data, size_t& len) {
+        size_t n = std::min(len, 16 - bufLen_);
+        memcpy(buf_ + bufLen_, data, n);
+        bufLen_ += n;
+        data += n;
+        len -= n;
+        return len > 0 ? 1 + (len - 1) / 16 : 0;
+    }
+
+    // 第i个进链的分组：第0个是buf_，其后依次取自data
+    const uint8_t* block(const uint8_t* data, size_t i) const {
+        return i == 0 ? buf_ : data + 16 * (i - 1);
+    }
+
+    // 进链完成后把最后1 ~ 16字节放回buf_
+    void keepTail(const uint8_t* data, size_t len, size_t blocks) {
+        if (blocks > 0) {
+            bufLen_ = len - 16 * (blocks - 1);
+            memcpy(buf_, data + 16 * (blocks - 1), bufLen_);
+        }
+    }
+
+    const Sm4CmacKey* key_;
+    Sm4BlocksFunc kernel_;
+    uint8_t X_[16];         // 链值
+    uint8_t buf_[16];       // 尚未进链的最后1 ~ 16字节
+    size_t bufLen_;
+};
+
+// -------------------------- 多流CMAC --------------------------
+
+// 每个通道依次领取一个流，各通道每次各推进一个分组，流结束后立即领取下一个
+// (与sm4CbcEncryptStreamsWith相同)。各流可以用不同的密钥，但同一个上下文在一次调用中只能出现一次。
+// 未init的上下文被跳过
+inline void sm4CmacUpdateStreamsWith(const Sm4LaneKernel& lk, Sm4CmacStream* streams, size_t count) {
+    const size_t W = lk.lanes;
+    alignas(64) uint32_t rkLanes[32 * kSm4MaxLanes];
+    alignas(64) uint8_t buf[kSm4MaxLanes * 16] = { 0 };
+    Sm4CmacStream* lane[kSm4MaxLanes] = { nullptr };
+    const uint8_t* data[kSm4MaxLanes] = { nullptr };
+    size_t len[kSm4MaxLanes] = { 0 }, blocks[kSm4MaxLanes] = { 0 }, pos[kSm4MaxLanes] = { 0 };
+    size_t next = 0;
+    memset(rkLanes, 0, sizeof(rkLanes));
+
+    for (;;) {
+        bool active = false;
+        for (size_t b = 0; b < W; b++) {
+            // 补满buf_后没有分组要进链的流 (数据不足以确定最后一个分组) 不占用通道
+            while (lane[b] == nullptr && next < count) {
+                Sm4CmacStream* s = &streams[next++];
+                if (s->ctx->key_ == nullptr) {
+                    continue;
+                }
+                data[b] = s->data;
+                len[b] = s->len;
+                blocks[b] = s->ctx->prepare(data[b], len[b]);
+                if (blocks[b] > 0) {
+                    lane[b] = s;
+                    pos[b] = 0;
+                    sm4SetLaneKey(rkLanes, W, b, s->ctx->key_->key.enc);
+                }
+            }
+            if (lane[b] != nullptr) {
+                active = true;
+                Sm4Cmac* c = lane[b]->ctx;
+                xorBlock16(buf + 16 * b, c->X_, c->block(data[b], pos[b]));
+            }
+        }
+        if (!active) {
+            break;
+        }
+
+        lk.encrypt_lanes(rkLanes, buf, buf);
+
+        for (size_t b = 0; b < W; b++) {
+            if (lane[b] == nullptr) {
+                continue;
+            }
+            Sm4Cmac* c = lane[b]->ctx;
+            memcpy(c->X_, buf + 16 * b, 16);
+            if (++pos[b] == blocks[b]) {
+                c->keepTail(data[b], len[b], blocks[b]);
+                lane[b] = nullptr;
+            }
+        }
+    }
+    sm4Wipe(rkLanes, sizeof(rkLanes));
+    sm4Wipe(buf, sizeof(buf));
+}
+
+inline void sm4CmacUpdateStreams(Sm4CmacStream* streams, size_t count) {
+    sm4CmacUpdateStreamsWith(*g_sm4LaneKernel, streams, count);
+}
+
+inline void sm4Cmac(const Sm4CmacKey& key, const uint8_t* data, size_t len, uint8_t tag[16]) {
+    Sm4Cmac mac;
+    mac.init(key);
+    mac.update(data, len);
+    mac.finalize(tag);
+}
@@ -0,0 +1,257 @@
+#pragma once
+// SM4多缓冲任务调度 (接口仿照intel-ipsec-mb的submit/flush)：
+// 大量短消息 (64 ~ 512字节) 各自带密钥和IV，单条消息只有几个分组，填不满SIMD内核。
+// 管理器把每个任务放进多路内核的一个通道，每次内核调用为所有通道各推进一个分组；
+// 通道占满时才开始计算，或由flush显式推进。结果直接写入任务的dst，不经过中间缓冲区
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+
+#include "sm4.h"
+#include "sm4_key.h"
+#include "sm4_lanes.h"
+
+enum Sm4JobMode {
+    SM4_ECB_ENCRYPT,
+    SM4_ECB_DECRYPT,
+    SM4_CBC_ENCRYPT,
+    SM4_CBC_DECRYPT,
+    SM4_CTR,            // 128位大端计数器，加解密相同
+};
+
+enum Sm4JobStatus {
+    SM4_JOB_PENDING,    // 已提交，尚未完成
+    SM4_JOB_COMPLETED,
+    SM4_JOB_INVALID,    // 参数不合法，未做任何处理
+};
+
+// 任务由调用者持有，提交后到被submit/flush返回之前不得修改或释放
+struct Sm4Job {
+    Sm4JobMode mode;
+    const Sm4Key* key;
+    uint8_t iv[16];         // CBC为初始向量，完成后为最后一个密文分组；CTR为初始计数器，完成后为下一个计数器
+    const uint8_t* src;
+    uint8_t* dst;           // 可以与src相同
+    size_t len;             // 字节数：ECB/CBC须为16的倍数，CTR可以是任意长度
+    Sm4JobStatus status;
+    void* userData;         // 调用者自用，管理器不访问
+};
+
+// 128位大端计数器加一
+inline void sm4CounterInc128(uint8_t ctr[16]) {
+    for (int i = 15; i >= 0; i--) {
+        if (++ctr[i] != 0) {
+            break;
+        }
+    }
+}
+
+class Sm4MbManager {
+public:
+    explicit Sm4MbManager(const Sm4LaneKernel& kernel = *g_sm4LaneKernel)
+        : kernel_(kernel), active_(0) {
+        memset(rkLanes_, 0, sizeof(rkLanes_));
+        memset(in_, 0, sizeof(in_));
+        for (size_t b = 0; b < kSm4MaxLanes; b++) {
+            lanes_[b].job = nullptr;
+        }
+    }
+
+    // 轮密钥、通道中的明文/密钥流和链接值都要清除
+    ~Sm4MbManager() {
+        sm4Wipe(rkLanes_, sizeof(rkLanes_));
+        sm4Wipe(in_, sizeof(in_));
+        sm4Wipe(out_, sizeof(out_));
+        for (size_t b = 0; b < kSm4MaxLanes; b++) {
+            sm4Wipe(lanes_[b].chain, sizeof(lanes_[b].chain));
+        }
+    }
+
+    Sm4MbManager(const Sm4MbManager&) = delete;
+    Sm4MbManager& operator=(const Sm4MbManager&) = delete;
+
+    // 提交任务。任务放入空闲通道；所有通道都被占用时，推进到至少一个任务完成为止。
+    // 返回一个已完成的任务 (含参数不合法的任务)，暂时没有则返回nullptr
+    Sm4Job* submit(Sm4Job* job) {
+        if (!validate(job)) {
+            job->status = SM4_JOB_INVALID;
+            completed_.push_back(job);
+        }
+        else if (job->len == 0) {
+            job->status = SM4_JOB_COMPLETED;
+            completed_.push_back(job);
+        }
+        else {
+            job->status = SM4_JOB_PENDING;
+            admit(job);
+            if (active_ == kernel_.lanes) {
+                runUntilCompletion();
+            }
+        }
+        return popCompleted();
+    }
+
+    // 不等通道占满，推进到至少一个任务完成并返回它；没有未取回的任务时返回nullptr。
+    // 循环调用直到返回nullptr即可清空管理器
+    Sm4Job* flush() {
+        if (completed_.empty() && active_ > 0) {
+            runUntilCompletion();
+        }
+        return popCompleted();
+    }
+
+    // 已提交但尚未被submit/flush返回的任务数
+    size_t pending() const {
+        return active_ + completed_.size();
+    }
+
+    size_t lanes() const {
+        return kernel_.lanes;
+    }
+
+    const char* kernelName() const {
+        return kernel_.name;
+    }
+
+private:
+    struct Lane {
+        Sm4Job* job;
+        size_t off;             // 已处理的字节数
+        uint8_t chain[16];      // CBC：上一个密文分组；CTR：当前计数器
+    };
+
+    static bool validate(const Sm4Job* job) {
+        if (job->key == nullptr || (job->len > 0 && (job->src == nullptr || job->dst == nullptr))) {
+            return false;
+        }
+        switch (job->mode) {
+        case SM4_ECB_ENCRYPT:
+        case SM4_ECB_DECRYPT:
+        case SM4_CBC_ENCRYPT:
+        case SM4_CBC_DECRYPT:
+            return job->len % 16 == 0;
+        case SM4_CTR:
+            return true;
+        }
+        return false;
+    }
+
+    static bool usesDecryptKey(Sm4JobMode mode) {
+        return mode == SM4_ECB_DECRYPT || mode == SM4_CBC_DECRYPT;
+    }
+
+    // 放入第一个空闲通道，写入该通道的轮密钥
+    void admit(Sm4Job* job) {
+        for (size_t b = 0; b < kernel_.lanes; b++) {
+            Lane& lane = lanes_[b];
+            if (lane.job == nullptr) {
+                lane.job = job;
+                lane.off = 0;
+                memcpy(lane.chain, job->iv, 16);
+                sm4SetLaneKey(rkLanes_, kernel_.lanes, b, usesDecryptKey(job->mode) ? job->key->dec : job->key->enc);
+                active_++;
+                return;
+            }
+        }
+    }
+
+    // 按剩余分组数最少的通道推进若干步，这段时间内所有通道都保持满载
+    void runUntilCompletion() {
+        size_t steps = SIZE_MAX;
+        for (size_t b = 0; b < kernel_.lanes; b++) {
+            const Lane& lane = lanes_[b];
+            if (lane.job != nullptr) {
+                steps = std::min(steps, (lane.job->len - lane.off + 15) / 16);
+            }
+        }
+        for (size_t i = 0; i < steps; i++) {
+            step();
+        }
+    }
+
+    // 所有活动通道各处理一个分组
+    void step() {
+        const size_t W = kernel_.lanes;
+        for (size_t b = 0; b < W; b++) {
+            Lane& lane = lanes_[b];
+            if (lane.job == nullptr) {
+                continue;
+            }
+            const uint8_t* src = lane.job->src + lane.off;
+            switch (lane.job->mode) {
+            case SM4_CBC_ENCRYPT:
+                xorBlock16(in_ + 16 * b, src, lane.chain);
+                break;
+            case SM4_CTR:
+                memcpy(in_ + 16 * b, lane.chain, 16);
+                sm4CounterInc128(lane.chain);
+                break;
+            default:
+                memcpy(in_ + 16 * b, src, 16);
+                break;
+            }
+        }
+
+        kernel_.encrypt_lanes(rkLanes_, in_, out_);
+
+        for (size_t b = 0; b < W; b++) {
+            Lane& lane = lanes_[b];
+            Sm4Job* job = lane.job;
+            if (job == nullptr) {
+                continue;
+            }
+            uint8_t* dst = job->dst + lane.off;
+            size_t n = 16;
+            switch (job->mode) {
+            case SM4_CBC_ENCRYPT:
+                memcpy(dst, out_ + 16 * b, 16);
+                memcpy(lane.chain, out_ + 16 * b, 16);
+                break;
+            case SM4_CBC_DECRYPT:
+                // 密文分组已复制到in_，原地解密时src被覆盖也不影响下一个分组
+                xorBlock16(dst, out_ + 16 * b, lane.chain);
+                memcpy(lane.chain, in_ + 16 * b, 16);
+                break;
+            case SM4_CTR:
+                n = std::min<size_t>(16, job->len - lane.off);
+                for (size_t i = 0; i < n; i++) {
+                    dst[i] = job->src[lane.off + i] ^ out_[16 * b + i];
+                }
+                break;
+            default:
+                memcpy(dst, out_ + 16 * b, 16);
+                break;
+            }
+
+            lane.off += n;
+            if (lane.off == job->len) {
+                if (job->mode != SM4_ECB_ENCRYPT && job->mode != SM4_ECB_DECRYPT) {
+                    memcpy(job->iv, lane.chain, 16);
+                }
+                job->status = SM4_JOB_COMPLETED;
+                completed_.push_back(job);
+                lane.job = nullptr;
+                active_--;
+            }
+        }
+    }
+
+    Sm4Job* popCompleted() {
+        if (completed_.empty()) {
+            return nullptr;
+        }
+        Sm4Job* job = completed_.front();
+        completed_.pop_front();
+        return job;
+    }
+
+    const Sm4LaneKernel& kernel_;
+    alignas(64) uint32_t rkLanes_[32 * kSm4MaxLanes];
+    alignas(64) uint8_t in_[16 * kSm4MaxLanes];
+    alignas(64) uint8_t out_[16 * kSm4MaxLanes];
+    Lane lanes_[kSm4MaxLanes];
+    size_t active_;
+    std::deque<Sm4Job*> completed_;
+};
@@ -0,0 +1,238 @@
+#pragma once
+// SM4-XTS (IEEE 1619 / GB/T 17964的XTS模式)：用于按扇区加密的块设备镜像。
+// 第j个分组：C_j = E_K1(P_j ^ T_j) ^ T_j，T_0 = E_K2(扇区号)，T_{j+1} = T_j·α (GF(2^128)上乘x)。
+// 一批扇区的T_0一次交给批量内核，扇区内的调整值在SSE寄存器中连续倍乘后与数据一起整批加密；
+// 扇区长度不是16的倍数时用密文窃取处理最后两个分组；大批量可以按扇区拆给多个线程
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "sm4.h"
+#include "sm4_key.h"
+
+// 每次交给批量内核的分组数 (同时也是一批中计算T_0的扇区数)
+const size_t kSm4XtsBatch = 64;
+
+struct Sm4XtsKey {
+    Sm4Key data;    // K1：加密数据
+    Sm4Key tweak;   // K2：加密扇区号
+    bool valid;     // set成功后为true；未设置或K1 == K2时加解密函数返回false
+
+    Sm4XtsKey() : valid(false) {
+    }
+
+    Sm4XtsKey(const uint8_t key1[16], const uint8_t key2[16]) : valid(false) {
+        set(key1, key2);
+    }
+
+    // 32字节密钥，前16字节为K1
+    explicit Sm4XtsKey(const uint8_t key[32]) : valid(false) {
+        set(key);
+    }
+
+    // IEEE 1619要求K1与K2互相独立，Linux的xts_verify_key也拒绝两半相同的密钥：
+    // K1 == K2时T_0 = E_K(扇区号) 与数据使用同一个置换，XTS的安全性证明不再成立。
+    // 两半相同时清空上下文并返回false
+    bool set(const uint8_t key1[16], const uint8_t key2[16]) {
+        valid = !sm4ConstTimeEqual(key1, key2, 16);
+        if (!valid) {
+            data.wipe();
+            tweak.wipe();
+            return false;
+        }
+        data.set(key1);
+        tweak.set(key2);
+        return true;
+    }
+
+    bool set(const uint8_t key[32]) {
+        return set(key, key + 16);
+    }
+};
+
+// -------------------------- 调整值 --------------------------
+
+// T·α：128位按小端整数左移1位，移出的最高位以0x87反馈到最低字节 (模x^128 + x^7 + x^2 + x + 1)。
+// 每个32位字各自左移，字间进位由psrad取出符号位后旋转一个字得到 (SSE2)
+inline __m128i xtsMulAlpha(__m128i t) {
+    __m128i carry = _mm_shuffle_epi32(_mm_srai_epi32(t, 31), 0x93);
+    carry = _mm_and_si128(carry, _mm_set_epi32(1, 1, 1, 0x87));
+    return _mm_xor_si128(_mm_slli_epi32(t, 1), carry);
+}
+
+// 从t开始写出n个连续的调整值，t更新为t·α^n
+inline void xtsTweaks(uint8_t* out, size_t n, uint8_t t[16]) {
+    __m128i x = _mm_loadu_si128((const __m128i*)t);
+    for (size_t i = 0; i < n; i++) {
+        _mm_storeu_si128((__m128i*)(out + 16 * i), x);
+        x = xtsMulAlpha(x);
+    }
+    _mm_storeu_si128((__m128i*)t, x);
+}
+
+// -------------------------- 数据单元 --------------------------
+
+// 单个分组：out = E(in ^ t) ^ t
+inline void xtsBlock(Sm4BlocksFunc kernel, const uint32_t rk[32], const uint8_t t[16], const uint8_t* in, uint8_t* out) {
+    uint8_t buf[16];
+    xorBlock16(buf, in, t);
+    kernel(rk, buf, buf, 1);
+    xorBlock16(out, buf, t);
+    sm4Wipe(buf, sizeof(buf));
+}
+
+// 处理一个数据单元 (扇区)。t为已加密的T_0；rk为K1的加密或解密轮密钥。
+// len >= 16，in与out可以相同
+inline void sm4XtsUnit(Sm4BlocksFunc kernel, const uint32_t rk[32], bool decrypt, const uint8_t t0[16],
+    const uint8_t* in, uint8_t* out, size_t len) {
+    alignas(16) uint8_t t[16];
+    memcpy(t, t0, 16);
+    size_t r = len % 16;
+    size_t blocks = len / 16 - (r != 0 ? 1 : 0);   // 有密文窃取时最后一个完整分组单独处理
+
+    alignas(64) uint8_t tw[kSm4XtsBatch * 16];
+    alignas(64) uint8_t buf[kSm4XtsBatch * 16];
+    const size_t used = 16 * std::min(blocks, kSm4XtsBatch);
+    while (blocks > 0) {
+        size_t n = std::min(blocks, kSm4XtsBatch);
+        xtsTweaks(tw, n, t);
+        xorBytes(buf, in, tw, 16 * n);
+        kernel(rk, buf, buf, n);
+        xorBytes(out, buf, tw, 16 * n);
+        in += 16 * n;
+        out += 16 * n;
+        blocks -= n;
+    }
+    // 调整值和经过分组密码前后的数据都不留在栈上
+    sm4Wipe(tw, used);
+    sm4Wipe(buf, used);
+    if (r == 0) {
+        sm4Wipe(t, sizeof(t));
+        return;
+    }
+
+    // 密文窃取：in指向最后一个完整分组，其后还有r字节
+    uint8_t t1[16], t2[16], cc[16], pp[16];
+    memcpy(t1, t, 16);
+    _mm_storeu_si128((__m128i*)t2, xtsMulAlpha(_mm_loadu_si128((const __m128i*)t1)));
+    if (!decrypt) {
+        xtsBlock(kernel, rk, t1, in, cc);
+        memcpy(pp, in + 16, r);
+        memcpy(pp + r, cc + r, 16 - r);
+        memcpy(out + 16, cc, r);
+        xtsBlock(kernel, rk, t2, pp, out);
+    }
+    else {
+        // 解密时顺序相反：倒数第二个密文分组用T_{m}，拼接出的分组用T_{m-1}
+        xtsBlock(kernel, rk, t2, in, pp);
+        memcpy(cc, in + 16, r);
+        memcpy(cc + r, pp + r, 16 - r);
+        memcpy(out + 16, pp, r);
+        xtsBlock(kernel, rk, t1, cc, out);
+    }
+    sm4Wipe(t, sizeof(t));
+    sm4Wipe(t1, sizeof(t1));
+    sm4Wipe(t2, sizeof(t2));
+    sm4Wipe(cc, sizeof(cc));
+    sm4Wipe(pp, sizeof(pp));
+}
+
+// 任意调整值的单个数据单元。tweak为未加密的128位调整值 (IEEE 1619中扇区号的小端表示)。
+// len < 16时无法做密文窃取，返回false；密钥无效时也返回false
+inline bool sm4XtsEncrypt(const Sm4XtsKey& key, const uint8_t tweak[16], const uint8_t* in, uint8_t* out, size_t len) {
+    if (len < 16 || !key.valid) {
+        return false;
+    }
+    uint8_t t0[16];
+    sm4_encrypt_blocks(key.tweak, tweak, t0, 1);
+    sm4XtsUnit(g_sm4Kernel->encrypt_blocks, key.data.enc, false, t0, in, out, len);
+    sm4Wipe(t0, sizeof(t0));
+    return true;
+}
+
+inline bool sm4XtsDecrypt(const Sm4XtsKey& key, const uint8_t tweak[16], const uint8_t* in, uint8_t* out, size_t len) {
+    if (len < 16 || !key.valid) {
+        return false;
+    }
+    uint8_t t0[16];
+    sm4_encrypt_blocks(key.tweak, tweak, t0, 1);
+    sm4XtsUnit(g_sm4Kernel->encrypt_blocks, key.data.dec, true, t0, in, out, len);
+    sm4Wipe(t0, sizeof(t0));
+    return true;
+}
+
+// -------------------------- 批量扇区 --------------------------
+
+// 连续nSectors个扇区 (扇区号从startSector开始) 在单个线程内处理
+inline void sm4XtsSectorsRange(Sm4BlocksFunc kernel, const Sm4XtsKey& key, bool decrypt, uint64_t startSector,
+    const uint8_t* in, uint8_t* out, size_t nSectors, size_t sectorSize) {
+    const uint32_t* rk = decrypt ? key.data.dec : key.data.enc;
+    alignas(64) uint8_t t0[kSm4XtsBatch * 16];
+    const size_t used = 16 * std::min(nSectors, kSm4XtsBatch);
+    while (nSectors > 0) {
+        size_t n = std::min(nSectors, kSm4XtsBatch);
+        // 一批扇区号 (128位小端) 一次加密
+        memset(t0, 0, 16 * n);
+        for (size_t i = 0; i < n; i++) {
+            uint64_t sector = startSector + i;
+            for (int b = 0; b < 8; b++) {
+                t0[16 * i + b] = (uint8_t)(sector >> (8 * b));
+            }
+        }
+        kernel(key.tweak.enc, t0, t0, n);
+
+        for (size_t i = 0; i < n; i++) {
+            sm4XtsUnit(kernel, rk, decrypt, t0 + 16 * i, in, out, sectorSize);
+            in += sectorSize;
+            out += sectorSize;
+        }
+        startSector += n;
+        nSectors -= n;
+    }
+    sm4Wipe(t0, used);
+}
+
+// threads > 1时把扇区按连续区间平均分给各线程 (当前线程处理第一段)
+inline bool sm4XtsSectors(const Sm4XtsKey& key, bool decrypt, uint64_t startSector,
+    const uint8_t* in, uint8_t* out, size_t nSectors, size_t sectorSize, unsigned threads) {
+    if (sectorSize < 16 || !key.valid) {
+        return false;
+    }
+    Sm4BlocksFunc kernel = g_sm4Kernel->encrypt_blocks;
+    size_t parts = std::max<size_t>(1, std::min<size_t>(threads, nSectors));
+    if (parts == 1) {
+        sm4XtsSectorsRange(kernel, key, decrypt, startSector, in, out, nSectors, sectorSize);
+        return true;
+    }
+
+    std::vector<std::thread> workers;
+    size_t per = nSectors / parts, extra = nSectors % parts;
+    size_t first = per + (extra > 0 ? 1 : 0);
+    size_t begin = first;
+    for (size_t p = 1; p < parts; p++) {
+        size_t count = per + (p < extra ? 1 : 0);
+        workers.emplace_back(sm4XtsSectorsRange, kernel, std::cref(key), decrypt, startSector + begin,
+            in + begin * sectorSize, out + begin * sectorSize, count, sectorSize);
+        begin += count;
+    }
+    sm4XtsSectorsRange(kernel, key, decrypt, startSector, in, out, first, sectorSize);
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    return true;
+}
+
+// 加密连续的一批扇区：第i个扇区的扇区号为startSector + i。
+// sectorSize默认4 KiB，可以不是16的倍数 (走密文窃取)，但不能小于16
+inline bool sm4XtsEncryptSectors(const Sm4XtsKey& key, uint64_t startSector, const uint8_t* in, uint8_t* out,
+    size_t nSectors, size_t sectorSize = 4096, unsigned threads = 1) {
+    return sm4XtsSectors(key, false, startSector, in, out, nSectors, sectorSize, threads);
+}
+
+inline bool sm4XtsDecryptSectors(const Sm4XtsKey& key, uint64_t startSector, const uint8_t* in, uint8_t* out,
+    size_t nSectors, size_t sectorSize = 4096, unsigned threads = 1) {
+    return sm4XtsSectors(key, true, startSector, in, out, nSectors, sectorSize, threads);
+}
@@ -0,0 +1,781 @@
+// sm4crypt：用SM4-CTR / SM4-GCM加解密文件。
+// 输入输出文件用mmap映射 (或对大文件用O_DIRECT + pread/pwrite)，文件按块分给线程池，
+// 每块从 初始计数器 + 块偏移/16 开始加密，结果直接写入输出映射，最后报告吞吐量 (GB/s)。
+// GCM模式下每块同时算出自己的部分GHASH值，全部完成后乘以H的相应次幂合并成标签。
+// Linux上--io uring改用io_uring流水线：固定数量的注册缓冲区轮流 读入 -> 线程池加解密 -> 原地写出，
+// 读、算、写三级重叠，结束时报告各阶段的延迟直方图
+//
+// 编译：g++ -O2 -std=c++17 -pthread sm4crypt.cpp -o sm4crypt
+// 用法：sm4crypt enc|dec -k 密钥(32个十六进制字符) --iv IV(十六进制) [-m ctr|gcm] [-t 线程数]
+//                [--chunk 字节] [--io auto|mmap|direct|uring] [--qd 队列深度] 输入文件 输出文件
+// CTR模式的IV为16字节初始计数器 (128位递增)；GCM模式的IV一般为12字节，
+// 加密输出为 密文 || 16字节标签，解密时在同一趟中计算标签，不符时返回1。
+// 输出先写到同目录下的临时文件，成功后才rename为输出文件，失败时不会留下或破坏输出文件
+
+#if defined(_WIN32)
+#error "sm4crypt依赖mmap/pread，目前只支持POSIX系统"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+#include "sm4_key.h"
+#include "sm4_ctr.h"
+#include "sm4_gcm.h"
+#if defined(__linux__)
+#include "uring.h"
+#endif
+
+using namespace std;
+
+// 超过该大小时--io auto改用O_DIRECT，避免整个文件经过页缓存
+const uint64_t kDirectThreshold = (uint64_t)4 << 30;
+// O_DIRECT要求的偏移、长度和缓冲区对齐
+const size_t kDirectAlign = 4096;
+
+struct Options {
+    bool decrypt = false;
+    bool gcm = false;
+    string io = "auto";
+    unsigned threads = 0;
+    size_t chunk = (size_t)4 << 20;     // --io uring时即每个缓冲区的大小
+    unsigned queueDepth = 8;            // --io uring时同时在途的缓冲区数
+    vector<uint8_t> key, iv;
+    string input, output;
+    string tmpOutput;                   // 实际写入的临时文件，成功后rename为output
+};
+
+static bool parseHex(const char* s, vector<uint8_t>& out) {
+    size_t n = strlen(s);
+    if (n % 2 != 0) {
+        return false;
+    }
+    out.clear();
+    for (size_t i = 0; i < n; i += 2) {
+        unsigned v;
+        if (sscanf(s + i, "%2x", &v) != 1) {
+            return false;
+        }
+        out.push_back((uint8_t)v);
+    }
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr, "用法: sm4crypt enc|dec -k 密钥 --iv IV [-m ctr|gcm] [-t 线程数] [--chunk 字节] [--io auto|mmap|direct|uring] [--qd 队列深度] 输入 输出\n");
+}
+
+// -------------------------- 线程池 --------------------------
+
+// threads个线程从原子计数器领取块号，直到nChunks个块处理完
+template<typename Func>
+static void runParallel(size_t nChunks, unsigned threads, Func func) {
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next.fetch_add(1); i < nChunks; i = next.fetch_add(1)) {
+            func(i);
+        }
+    };
+    vector<thread> pool;
+    for (unsigned t = 1; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (thread& t : pool) {
+        t.join();
+    }
+}
+
+// 加解密所需的密钥材料：CTR只用其中的轮密钥
+struct CryptKey {
+    Sm4GcmKey key;
+    uint8_t ctr0[16];       // 数据部分的初始计数器 (GCM为J0 + 1)
+    uint8_t J0[16];         // 仅GCM
+    Sm4CtrIncrement inc;
+};
+
+// 处理从offset (16的倍数) 开始的一段数据，计数器从ctr0前移offset/16；
+// GCM时T为这一段密文单独的GHASH值
+static void cryptRange(const Options& o, const CryptKey& k, uint64_t offset, const uint8_t* in, uint8_t* out, size_t len, Gf128& T) {
+    if (o.gcm) {
+        sm4GcmSegment(k.key, k.ctr0, offset / 16, in, out, len, o.decrypt, T);
+        return;
+    }
+    uint8_t ctr[16];
+    memcpy(ctr, k.ctr0, 16);
+    sm4CounterAdd(ctr, offset / 16, k.inc);
+    Sm4Ctr c(k.key.key, ctr, k.inc);
+    c.update(in, out, len);
+}
+
+// 合并各块的部分GHASH值得到标签：加密时写入tagOut，解密时与tagIn比较
+static bool gcmFinish(const CryptKey& k, const vector<Gf128>& partial, size_t chunk, uint64_t dataLen,
+    uint8_t* tagOut, const uint8_t* tagIn) {
+    uint8_t tag[16];
+    sm4GcmCombineTag(k.key, k.J0, Gf128{ 0, 0 }, partial.data(), partial.size(), chunk / 16, 0, dataLen, tag);
+    if (tagOut != nullptr) {
+        memcpy(tagOut, tag, 16);
+        return true;
+    }
+    if (!sm4GcmTagEqual(tag, tagIn, 16)) {
+        fprintf(stderr, "认证标签不符，未生成输出文件\n");
+        return false;
+    }
+    return true;
+}
+
+// -------------------------- mmap --------------------------
+
+static int runMmap(const Options& o, const CryptKey& k, int fin, uint64_t inSize, int fout, double& seconds) {
+    uint64_t dataLen = (o.gcm && o.decrypt) ? inSize - 16 : inSize;
+    uint64_t outSize = (o.gcm && !o.decrypt) ? dataLen + 16 : dataLen;
+    if (ftruncate(fout, (off_t)outSize) != 0) {
+        perror("ftruncate");
+        return 1;
+    }
+
+    const uint8_t* in = nullptr;
+    uint8_t* out = nullptr;
+    if (inSize > 0) {
+        void* p = mmap(nullptr, inSize, PROT_READ, MAP_SHARED, fin, 0);
+        if (p == MAP_FAILED) {
+            perror("mmap 输入");
+            return 1;
+        }
+        madvise(p, inSize, MADV_SEQUENTIAL);
+        in = (const uint8_t*)p;
+    }
+    if (outSize > 0) {
+        void* p = mmap(nullptr, outSize, PROT_READ | PROT_WRITE, MAP_SHARED, fout, 0);
+        if (p == MAP_FAILED) {
+            perror("mmap 输出");
+            return 1;
+        }
+        out = (uint8_t*)p;
+    }
+
+    auto start = chrono::steady_clock::now();
+    int rc = 0;
+    size_t nChunks = (size_t)((dataLen + o.chunk - 1) / o.chunk);
+    vector<Gf128> partial(max<size_t>(1, nChunks), Gf128{ 0, 0 });
+    runParallel(nChunks, o.threads, [&](size_t i) {
+        uint64_t off = (uint64_t)i * o.chunk;
+        size_t len = (size_t)min<uint64_t>(o.chunk, dataLen - off);
+        cryptRange(o, k, off, in + off, out + off, len, partial[i]);
+    });
+    if (o.gcm && !gcmFinish(k, partial, o.chunk, dataLen, o.decrypt ? nullptr : out + dataLen, in + dataLen)) {
+        rc = 1;
+    }
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (in != nullptr) {
+        munmap((void*)in, inSize);
+    }
+    if (out != nullptr) {
+        munmap(out, outSize);
+    }
+    return rc;
+}
+
+// -------------------------- O_DIRECT --------------------------
+
+// 每个线程一块对齐缓冲区：pread -> 原地加密 -> pwrite。
+// 对齐的部分走O_DIRECT描述符，文件末尾不足对齐长度的部分走普通描述符
+static int runDirect(const Options& o, const CryptKey& k, int fin, uint64_t inSize, int fout, double& seconds) {
+    int dfin = open(o.input.c_str(), O_RDONLY | O_DIRECT);
+    int dfout = open(o.tmpOutput.c_str(), O_WRONLY | O_DIRECT);
+    if (dfin < 0 || dfout < 0) {
+        fprintf(stderr, "警告: 无法以O_DIRECT打开文件，改用普通pread/pwrite\n");
+        if (dfin >= 0) {
+            close(dfin);
+        }
+        if (dfout >= 0) {
+            close(dfout);
+        }
+        dfin = fin;
+        dfout = fout;
+    }
+    uint64_t dataLen = (o.gcm && o.decrypt) ? inSize - 16 : inSize;
+    uint64_t outSize = (o.gcm && !o.decrypt) ? dataLen + 16 : dataLen;
+    if (ftruncate(fout, (off_t)outSize) != 0) {
+        perror("ftruncate");
+        return 1;
+    }
+
+    size_t chunk = (o.chunk + kDirectAlign - 1) / kDirectAlign * kDirectAlign;
+    size_t nChunks = (size_t)((dataLen + chunk - 1) / chunk);
+    vector<Gf128> partial(max<size_t>(1, nChunks), Gf128{ 0, 0 });
+    atomic<bool> failed(false);
+    auto start = chrono::steady_clock::now();
+
+    runParallel(nChunks, o.threads, [&](size_t i) {
+        // 每个线程第一次领取任务时分配缓冲区
+        thread_local vector<uint8_t> storage;
+        if (storage.size() < chunk + kDirectAlign) {
+            storage.assign(chunk + kDirectAlign, 0);
+        }
+        uint8_t* buf = (uint8_t*)(((uintptr_t)storage.data() + kDirectAlign - 1) & ~(uintptr_t)(kDirectAlign - 1));
+
+        uint64_t off = (uint64_t)i * chunk;
+        size_t len = (size_t)min<uint64_t>(chunk, dataLen - off);
+        size_t aligned = len / kDirectAlign * kDirectAlign;
+        if ((aligned > 0 && pread(dfin, buf, aligned, (off_t)off) != (ssize_t)aligned) ||
+            (len > aligned && pread(fin, buf + aligned, len - aligned, (off_t)(off + aligned)) != (ssize_t)(len - aligned))) {
+            failed = true;
+            return;
+        }
+        cryptRange(o, k, off, buf, buf, len, partial[i]);
+        if ((aligned > 0 && pwrite(dfout, buf, aligned, (off_t)off) != (ssize_t)aligned) ||
+            (len > aligned && pwrite(fout, buf + aligned, len - aligned, (off_t)(off + aligned)) != (ssize_t)(len - aligned))) {
+            failed = true;
+        }
+    });
+
+    // GCM标签紧跟在数据之后，不满足O_DIRECT的对齐，走普通描述符
+    int rc = 0;
+    if (failed) {
+        fprintf(stderr, "读写文件失败\n");
+        rc = 1;
+    }
+    else if (o.gcm) {
+        uint8_t tag[16];
+        if (o.decrypt) {
+            if (pread(fin, tag, 16, (off_t)dataLen) != 16) {
+                fprintf(stderr, "读写文件失败\n");
+                rc = 1;
+            }
+            else if (!gcmFinish(k, partial, chunk, dataLen, nullptr, tag)) {
+                rc = 1;
+            }
+        }
+        else {
+            gcmFinish(k, partial, chunk, dataLen, tag, nullptr);
+            if (pwrite(fout, tag, 16, (off_t)dataLen) != 16) {
+                fprintf(stderr, "读写文件失败\n");
+                rc = 1;
+            }
+        }
+    }
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (dfin != fin) {
+        close(dfin);
+        close(dfout);
+    }
+    return rc;
+}
+
+// -------------------------- io_uring --------------------------
+
+#if defined(__linux__)
+
+// 延迟直方图：第b个桶统计 [2^b, 2^(b+1)) 微秒的样本 (第0个桶含不足1微秒的)
+struct LatencyHistogram {
+    static const int kBuckets = 40;
+    uint64_t bucket[kBuckets] = { 0 };
+    uint64_t count = 0;
+    double sumUs = 0, maxUs = 0;
+
+    void add(chrono::steady_clock::time_point from, chrono::steady_clock::time_point to) {
+        double us = chrono::duration<double, micro>(to - from).count();
+        int b = 0;
+        while (b + 1 < kBuckets && us >= ldexp(1.0, b + 1)) {
+            b++;
+        }
+        bucket[b]++;
+        count++;
+        sumUs += us;
+        maxUs = max(maxUs, us);
+    }
+
+    // 第p分位的样本所在桶的上界 (微秒)
+    double percentile(double p) const {
+        uint64_t target = max<uint64_t>(1, (uint64_t)ceil(count * p));
+        uint64_t seen = 0;
+        for (int b = 0; b < kBuckets; b++) {
+            seen += bucket[b];
+            if (seen >= target) {
+                return ldexp(1.0, b + 1);
+            }
+        }
+        return ldexp(1.0, kBuckets);
+    }
+
+    void print(const char* name) const {
+        if (count == 0) {
+            return;
+        }
+        printf("  %s: %llu 次, 平均 %.1f us, p50 < %.0f us, p99 < %.0f us, 最大 %.1f us\n", name,
+            (unsigned long long)count, sumUs / count, percentile(0.5), percentile(0.99), maxUs);
+        uint64_t peak = 0;
+        for (int b = 0; b < kBuckets; b++) {
+            peak = max(peak, bucket[b]);
+        }
+        for (int b = 0; b < kBuckets; b++) {
+            if (bucket[b] == 0) {
+                continue;
+            }
+            size_t bar = (size_t)max<uint64_t>(1, bucket[b] * 40 / peak);
+            printf("    %9.0f ~ %9.0f us %8llu %s\n", b == 0 ? 0.0 : ldexp(1.0, b), ldexp(1.0, b + 1),
+                (unsigned long long)bucket[b], string(bar, '#').c_str());
+        }
+    }
+};
+
+// 一个在途缓冲区依次经过 读入 -> 加解密 -> 写出 三个阶段，之后领取下一块
+struct UringSlot {
+    uint8_t* buf;
+    size_t chunk;               // 块号
+    uint64_t off;               // 块在数据中的偏移
+    size_t len;                 // 块的数据长度
+    size_t ioLen;               // 本阶段要读写的字节数 (O_DIRECT时向上取整到对齐长度)
+    size_t done;                // 本阶段已读写的字节数，短读写时从这里续传
+    chrono::steady_clock::time_point submitted, queued, started, finished;
+};
+
+// 各槽位的读写请求以 槽位号*2 + (是否写) 为user_data，eventfd的读取另用一个标记
+const uint64_t kUringEventTag = ~(uint64_t)0;
+
+// 单线程事件循环驱动queueDepth个注册缓冲区：读入用READ_FIXED直接进缓冲区，读完交给线程池原地加解密，
+// 工作线程完成后通过eventfd唤醒事件循环，再用WRITE_FIXED从同一个缓冲区写出，数据不经过额外的拷贝。
+// 事件循环只等待io_uring：eventfd的读取也作为一个请求挂在环上。
+// 文件以O_DIRECT打开时最后一块按对齐长度读写，输出文件最后截断到实际大小
+static int runUring(const Options& o, const CryptKey& k, int fin, uint64_t inSize, int fout, double& seconds,
+    const char*& ioName) {
+    uint64_t dataLen = (o.gcm && o.decrypt) ? inSize - 16 : inSize;
+    uint64_t outSize = (o.gcm && !o.decrypt) ? dataLen + 16 : dataLen;
+    size_t chunk = (o.chunk + kDirectAlign - 1) / kDirectAlign * kDirectAlign;
+    size_t nChunks = (size_t)((dataLen + chunk - 1) / chunk);
+    // buf_index为16位，内核也限制注册缓冲区的个数
+    unsigned qd = (unsigned)min<size_t>(max<size_t>(1, min<size_t>(o.queueDepth, nChunks)), 1024);
+
+    // 声明顺序保证环先于缓冲区和evCount销毁
+    uint64_t evCount = 0;
+    vector<uint8_t> storage(qd * chunk + kDirectAlign);
+    uint8_t* base = (uint8_t*)(((uintptr_t)storage.data() + kDirectAlign - 1) & ~(uintptr_t)(kDirectAlign - 1));
+    Uring ring;
+    int err = ring.init(qd + 1);
+    if (err < 0) {
+        fprintf(stderr, "警告: io_uring不可用 (%s)，改用O_DIRECT + pread/pwrite\n", strerror(-err));
+        ioName = "O_DIRECT";
+        return runDirect(o, k, fin, inSize, fout, seconds);
+    }
+    vector<struct iovec> iov(qd);
+    for (unsigned s = 0; s < qd; s++) {
+        iov[s].iov_base = base + (size_t)s * chunk;
+        iov[s].iov_len = chunk;
+    }
+    err = ring.registerBuffers(iov.data(), qd);
+    bool fixed = (err == 0);
+    if (!fixed) {
+        fprintf(stderr, "警告: 无法注册固定缓冲区 (%s)，改用普通读写请求\n", strerror(-err));
+    }
+
+    int dfin = open(o.input.c_str(), O_RDONLY | O_DIRECT);
+    int dfout = open(o.tmpOutput.c_str(), O_WRONLY | O_DIRECT);
+    if (dfin < 0 || dfout < 0) {
+        fprintf(stderr, "警告: 无法以O_DIRECT打开文件，改用页缓存\n");
+        if (dfin >= 0) {
+            close(dfin);
+        }
+        if (dfout >= 0) {
+            close(dfout);
+        }
+        dfin = fin;
+        dfout = fout;
+    }
+    bool direct = (dfin != fin);
+    int efd = eventfd(0, EFD_CLOEXEC);
+    if (efd < 0 || ftruncate(fout, (off_t)outSize) != 0) {
+        perror(efd < 0 ? "eventfd" : "ftruncate");
+        if (efd >= 0) {
+            close(efd);
+        }
+        if (direct) {
+            close(dfin);
+            close(dfout);
+        }
+        return 1;
+    }
+
+    vector<UringSlot> slots(qd);
+    vector<unsigned> freeSlots;
+    for (unsigned s = 0; s < qd; s++) {
+        slots[s].buf = (uint8_t*)iov[s].iov_base;
+        freeSlots.push_back(qd - 1 - s);
+    }
+    vector<Gf128> partial(max<size_t>(1, nChunks), Gf128{ 0, 0 });
+    LatencyHistogram histRead, histQueue, histCrypt, histWrite;
+    auto start = chrono::steady_clock::now();
+
+    // 线程池：从todo领取读完的槽位，加解密后放进finished并通知eventfd
+    mutex m;
+    condition_variable cv;
+    deque<unsigned> todo;
+    vector<unsigned> finished;
+    bool stop = false;
+    auto worker = [&]() {
+        for (;;) {
+            unsigned s;
+            {
+                unique_lock<mutex> lock(m);
+                cv.wait(lock, [&]() { return stop || !todo.empty(); });
+                if (todo.empty()) {
+                    return;
+                }
+                s = todo.front();
+                todo.pop_front();
+            }
+            UringSlot& sl = slots[s];
+            sl.started = chrono::steady_clock::now();
+            cryptRange(o, k, sl.off, sl.buf, sl.buf, sl.len, partial[sl.chunk]);
+            sl.finished = chrono::steady_clock::now();
+            {
+                lock_guard<mutex> lock(m);
+                finished.push_back(s);
+            }
+            uint64_t one = 1;
+            ssize_t r = write(efd, &one, sizeof(one));
+            (void)r;
+        }
+    };
+    vector<thread> pool;
+    for (unsigned t = 0; t < o.threads; t++) {
+        pool.emplace_back(worker);
+    }
+
+    // 环的容量为qd + 1，每个槽位与eventfd各自最多只有一个未完成的请求，getSqe不会失败
+    auto submitIo = [&](unsigned s, bool write) {
+        UringSlot& sl = slots[s];
+        uringPrepRw(ring.getSqe(), write, write ? dfout : dfin, sl.buf + sl.done, (unsigned)(sl.ioLen - sl.done),
+            sl.off + sl.done, fixed ? (int)s : -1, (uint64_t)s * 2 + (write ? 1 : 0));
+    };
+    auto armEvent = [&]() {
+        uringPrepRw(ring.getSqe(), false, efd, &evCount, sizeof(evCount), 0, -1, kUringEventTag);
+    };
+    auto ioLength = [&](size_t len) {
+        return direct ? (len + kDirectAlign - 1) / kDirectAlign * kDirectAlign : len;
+    };
+
+    size_t nextChunk = 0;
+    bool failed = false;
+    armEvent();
+    while (freeSlots.size() < qd || (!failed && nextChunk < nChunks)) {
+        while (!failed && !freeSlots.empty() && nextChunk < nChunks) {
+            unsigned s = freeSlots.back();
+            freeSlots.pop_back();
+            UringSlot& sl = slots[s];
+            sl.chunk = nextChunk++;
+            sl.off = (uint64_t)sl.chunk * chunk;
+            sl.len = (size_t)min<uint64_t>(chunk, dataLen - sl.off);
+            // O_DIRECT读入时最后一块读到对齐长度，文件末尾处自然得到短读
+            sl.ioLen = ioLength(sl.len);
+            sl.done = 0;
+            sl.submitted = chrono::steady_clock::now();
+            submitIo(s, false);
+        }
+        err = ring.submitAndWait(1);
+        if (err < 0) {
+            // 无法再确认在途请求的状态，放弃等待
+            fprintf(stderr, "io_uring_enter: %s\n", strerror(-err));
+            failed = true;
+            break;
+        }
+
+        io_uring_cqe cqe;
+        while (ring.popCqe(cqe)) {
+            auto now = chrono::steady_clock::now();
+            if (cqe.user_data == kUringEventTag) {
+                vector<unsigned> done;
+                {
+                    lock_guard<mutex> lock(m);
+                    done.swap(finished);
+                }
+                armEvent();
+                for (unsigned s : done) {
+                    UringSlot& sl = slots[s];
+                    histQueue.add(sl.queued, sl.started);
+                    histCrypt.add(sl.started, sl.finished);
+                    if (failed) {
+                        freeSlots.push_back(s);
+                        continue;
+                    }
+                    // 对齐补齐的部分清零后一起写出，最后截断
+                    sl.ioLen = ioLength(sl.len);
+                    memset(sl.buf + sl.len, 0, sl.ioLen - sl.len);
+                    sl.done = 0;
+                    sl.submitted = now;
+                    submitIo(s, true);
+                }
+                continue;
+            }
+
+            unsigned s = (unsigned)(cqe.user_data / 2);
+            bool isWrite = (cqe.user_data & 1) != 0;
+            UringSlot& sl = slots[s];
+            if (cqe.res < 0 || (cqe.res == 0 && (isWrite || sl.done < sl.len))) {
+                if (!failed) {
+                    fprintf(stderr, "%s文件失败: %s\n", isWrite ? "写" : "读", strerror(cqe.res < 0 ? -cqe.res : EIO));
+                }
+                failed = true;
+                freeSlots.push_back(s);
+                continue;
+            }
+            sl.done += (size_t)cqe.res;
+            if (!isWrite && cqe.res > 0 && sl.done < sl.len) {
+                submitIo(s, false);
+                continue;
+            }
+            if (isWrite && sl.done < sl.ioLen) {
+                submitIo(s, true);
+                continue;
+            }
+            if (!isWrite) {
+                histRead.add(sl.submitted, now);
+                sl.queued = now;
+                {
+                    lock_guard<mutex> lock(m);
+                    todo.push_back(s);
+                }
+                cv.notify_one();
+            }
+            else {
+                histWrite.add(sl.submitted, now);
+                freeSlots.push_back(s);
+            }
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(m);
+        stop = true;
+    }
+    cv.notify_all();
+    for (thread& t : pool) {
+        t.join();
+    }
+    if (err >= 0) {
+        // 唤醒挂起的eventfd读取，此后环中不再有未完成的请求
+        uint64_t one = 1;
+        ssize_t r = write(efd, &one, sizeof(one));
+        (void)r;
+        io_uring_cqe cqe;
+        for (bool seen = false; !seen && ring.submitAndWait(1) >= 0;) {
+            while (ring.popCqe(cqe)) {
+                seen = seen || cqe.user_data == kUringEventTag;
+            }
+        }
+    }
+
+    int rc = 0;
+    if (failed) {
+        rc = 1;
+    }
+    else if (direct && ftruncate(fout, (off_t)outSize) != 0) {
+        perror("ftruncate");
+        rc = 1;
+    }
+    else if (o.gcm) {
+        // GCM标签紧跟在数据之后，走普通描述符
+        uint8_t tag[16];
+        if (o.decrypt) {
+            if (pread(fin, tag, 16, (off_t)dataLen) != 16) {
+                fprintf(stderr, "读写文件失败\n");
+                rc = 1;
+            }
+            else if (!gcmFinish(k, partial, chunk, dataLen, nullptr, tag)) {
+                rc = 1;
+            }
+        }
+        else {
+            gcmFinish(k, partial, chunk, dataLen, tag, nullptr);
+            if (pwrite(fout, tag, 16, (off_t)dataLen) != 16) {
+                fprintf(stderr, "读写文件失败\n");
+                rc = 1;
+            }
+        }
+    }
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    close(efd);
+    if (direct) {
+        close(dfin);
+        close(dfout);
+    }
+    if (rc == 0) {
+        printf("各阶段延迟 (队列深度 %u, 缓冲区 %zu 字节, %s%s):\n", qd, chunk, fixed ? "注册缓冲区" : "普通缓冲区",
+            direct ? ", O_DIRECT" : "");
+        histRead.print("读取");
+        histQueue.print("排队");
+        histCrypt.print("计算");
+        histWrite.print("写入");
+    }
+    return rc;
+}
+
+#endif
+
+int main(int argc, char** argv) {
+    Options o;
+    vector<string> positional;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasVal = i + 1 < argc;
+        if (arg == "-k" && hasVal) {
+            if (!parseHex(argv[++i], o.key) || o.key.size() != 16) {
+                fprintf(stderr, "密钥必须是32个十六进制字符\n");
+                return 2;
+            }
+        }
+        else if (arg == "--iv" && hasVal) {
+            if (!parseHex(argv[++i], o.iv) || o.iv.empty()) {
+                fprintf(stderr, "IV格式错误\n");
+                return 2;
+            }
+        }
+        else if (arg == "-m" && hasVal) {
+            string m = argv[++i];
+            if (m != "ctr" && m != "gcm") {
+                fprintf(stderr, "未知模式 %s\n", m.c_str());
+                return 2;
+            }
+            o.gcm = (m == "gcm");
+        }
+        else if (arg == "-t" && hasVal) o.threads = (unsigned)atoi(argv[++i]);
+        else if (arg == "--chunk" && hasVal) o.chunk = (size_t)strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--io" && hasVal) o.io = argv[++i];
+        else if (arg == "--qd" && hasVal) o.queueDepth = (unsigned)atoi(argv[++i]);
+        else if (arg.size() > 1 && arg[0] == '-') {
+            fprintf(stderr, "未知参数 %s\n", arg.c_str());
+            usage();
+            return 2;
+        }
+        else positional.push_back(arg);
+    }
+    if (positional.size() != 3 || (positional[0] != "enc" && positional[0] != "dec") || o.key.empty() || o.iv.empty()) {
+        usage();
+        return 2;
+    }
+    o.decrypt = (positional[0] == "dec");
+    o.input = positional[1];
+    o.output = positional[2];
+    if (!o.gcm && o.iv.size() != 16) {
+        fprintf(stderr, "CTR模式的IV必须是16字节\n");
+        return 2;
+    }
+    if (o.threads == 0) {
+        o.threads = max(1u, thread::hardware_concurrency());
+    }
+    // 块长度取16的倍数，各块的计数器偏移才是整数个分组
+    o.chunk = max<size_t>(16, o.chunk / 16 * 16);
+    o.queueDepth = max(1u, o.queueDepth);
+#if !defined(__linux__)
+    if (o.io == "uring") {
+        fprintf(stderr, "警告: io_uring只在Linux上可用，改用O_DIRECT\n");
+        o.io = "direct";
+    }
+#endif
+
+    int fin = open(o.input.c_str(), O_RDONLY);
+    if (fin < 0) {
+        perror(o.input.c_str());
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fin, &st) != 0) {
+        perror(o.input.c_str());
+        close(fin);
+        return 1;
+    }
+    // 输出与输入是同一个文件时 (同一路径或硬链接)，写输出会在读完之前毁掉输入
+    struct stat ost;
+    if (stat(o.output.c_str(), &ost) == 0 && ost.st_dev == st.st_dev && ost.st_ino == st.st_ino) {
+        fprintf(stderr, "输出文件与输入文件相同\n");
+        close(fin);
+        return 1;
+    }
+    uint64_t inSize = (uint64_t)st.st_size;
+    if (o.gcm && o.decrypt && inSize < 16) {
+        fprintf(stderr, "输入比认证标签还短\n");
+        close(fin);
+        return 1;
+    }
+
+    bool uring = (o.io == "uring");
+    bool direct = (o.io == "direct") || (o.io == "auto" && inSize >= kDirectThreshold);
+
+    // mkstemp建立的文件只有本次运行会写，失败时删除它不会影响任何已有文件
+    o.tmpOutput = o.output + ".XXXXXX";
+    int fout = mkstemp(&o.tmpOutput[0]);
+    if (fout < 0) {
+        perror(o.tmpOutput.c_str());
+        close(fin);
+        return 1;
+    }
+    mode_t mask = umask(0);
+    umask(mask);
+    fchmod(fout, 0644 & ~mask);
+
+    CryptKey k;
+    k.key.set(o.key.data());
+    k.inc = SM4_CTR_INC128;
+    if (o.gcm) {
+        // GCM的数据部分从J0 + 1开始，32位计数器
+        sm4GcmJ0(k.key.H, o.iv.data(), o.iv.size(), k.J0);
+        memcpy(k.ctr0, k.J0, 16);
+        sm4CounterAdd(k.ctr0, 1, SM4_CTR_INC32);
+        k.inc = SM4_CTR_INC32;
+    }
+    else {
+        memcpy(k.ctr0, o.iv.data(), 16);
+    }
+
+    double seconds = 0;
+    const char* ioName = uring ? "io_uring" : direct ? "O_DIRECT" : "mmap";
+    int rc;
+#if defined(__linux__)
+    if (uring) {
+        rc = runUring(o, k, fin, inSize, fout, seconds, ioName);
+    }
+    else
+#endif
+    rc = direct ? runDirect(o, k, fin, inSize, fout, seconds)
+        : runMmap(o, k, fin, inSize, fout, seconds);
+    close(fin);
+    close(fout);
+    if (rc != 0) {
+        unlink(o.tmpOutput.c_str());
+        return rc;
+    }
+    if (rename(o.tmpOutput.c_str(), o.output.c_str()) != 0) {
+        perror(o.output.c_str());
+        unlink(o.tmpOutput.c_str());
+        return 1;
+    }
+
+    // 吞吐量按数据部分计算，不含GCM标签
+    uint64_t dataLen = (o.gcm && o.decrypt) ? inSize - 16 : inSize;
+    printf("%s %s: %llu 字节, %.3f 秒, %.3f GB/s (内核 %s, %u 线程, %s)\n",
+        o.gcm ? "SM4-GCM" : "SM4-CTR", o.decrypt ? "解密" : "加密", (unsigned long long)dataLen, seconds,
+        seconds > 0 ? dataLen / seconds / 1e9 : 0.0, sm4_kernel_name(), o.threads, ioName);
+    return 0;
+}
@@ -0,0 +1,178 @@
+#pragma once
+// 最小的io_uring封装 (Linux 5.1+)：直接用io_uring_setup / io_uring_enter / io_uring_register系统调用，
+// 不依赖liburing。只提供sm4crypt需要的部分：取SQE、提交并等待、取CQE、注册固定缓冲区
+
+#if !defined(__linux__)
+#error "uring.h只支持Linux"
+#endif
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+class Uring {
+public:
+    Uring() : fd_(-1), sqPtr_(nullptr), cqPtr_(nullptr), sqes_(nullptr), sqMapLen_(0), cqMapLen_(0), sqesLen_(0),
+        sqTail_(0), sqSubmitted_(0) {
+    }
+
+    ~Uring() {
+        if (sqes_ != nullptr) {
+            munmap(sqes_, sqesLen_);
+        }
+        if (cqPtr_ != nullptr && cqPtr_ != sqPtr_) {
+            munmap(cqPtr_, cqMapLen_);
+        }
+        if (sqPtr_ != nullptr) {
+            munmap(sqPtr_, sqMapLen_);
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    // 建立至少entries项的提交队列，失败时返回-errno
+    int init(unsigned entries) {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        fd_ = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (fd_ < 0) {
+            return -errno;
+        }
+
+        // 5.4起SQ与CQ可以共用一次映射
+        sqMapLen_ = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+        cqMapLen_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single && cqMapLen_ > sqMapLen_) {
+            sqMapLen_ = cqMapLen_;
+        }
+        sqPtr_ = mapRing(sqMapLen_, IORING_OFF_SQ_RING);
+        if (sqPtr_ == nullptr) {
+            return -errno;
+        }
+        cqPtr_ = single ? sqPtr_ : mapRing(cqMapLen_, IORING_OFF_CQ_RING);
+        if (cqPtr_ == nullptr) {
+            return -errno;
+        }
+        sqesLen_ = p.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = (io_uring_sqe*)mapRing(sqesLen_, IORING_OFF_SQES);
+        if (sqes_ == nullptr) {
+            return -errno;
+        }
+
+        uint8_t* sq = (uint8_t*)sqPtr_;
+        uint8_t* cq = (uint8_t*)cqPtr_;
+        sqHead_ = (unsigned*)(sq + p.sq_off.head);
+        sqTailShared_ = (unsigned*)(sq + p.sq_off.tail);
+        sqMask_ = *(unsigned*)(sq + p.sq_off.ring_mask);
+        sqEntries_ = p.sq_entries;
+        sqArray_ = (unsigned*)(sq + p.sq_off.array);
+        cqHead_ = (unsigned*)(cq + p.cq_off.head);
+        cqTail_ = (unsigned*)(cq + p.cq_off.tail);
+        cqMask_ = *(unsigned*)(cq + p.cq_off.ring_mask);
+        cqes_ = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        sqTail_ = *sqTailShared_;
+        sqSubmitted_ = sqTail_;
+        return 0;
+    }
+
+    // 注册固定缓冲区，之后READ_FIXED / WRITE_FIXED用buf_index引用。失败时返回-errno
+    // (缓冲区会被锁定在内存中，受RLIMIT_MEMLOCK限制)
+    int registerBuffers(const struct iovec* iov, unsigned count) {
+        int r = (int)syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, iov, count);
+        return r < 0 ? -errno : 0;
+    }
+
+    // 取一个清零的SQE，队列已满时返回nullptr
+    io_uring_sqe* getSqe() {
+        unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (sqTail_ - head >= sqEntries_) {
+            return nullptr;
+        }
+        unsigned idx = sqTail_ & sqMask_;
+        io_uring_sqe* sqe = &sqes_[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray_[idx] = idx;
+        sqTail_++;
+        return sqe;
+    }
+
+    // 提交getSqe以来填好的SQE，并等待至少waitNr个完成事件。返回提交数或-errno
+    int submitAndWait(unsigned waitNr) {
+        unsigned toSubmit = sqTail_ - sqSubmitted_;
+        __atomic_store_n(sqTailShared_, sqTail_, __ATOMIC_RELEASE);
+        for (;;) {
+            int r = (int)syscall(__NR_io_uring_enter, fd_, toSubmit, waitNr, waitNr > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            if (r < 0) {
+                return -errno;
+            }
+            sqSubmitted_ += (unsigned)r;
+            return r;
+        }
+    }
+
+    // 取出一个完成事件，没有时返回false
+    bool popCqe(io_uring_cqe& out) {
+        unsigned head = *cqHead_;
+        if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        out = cqes_[head & cqMask_];
+        __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    void* mapRing(size_t len, off_t offset) {
+        void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    int fd_;
+    void* sqPtr_;
+    void* cqPtr_;
+    io_uring_sqe* sqes_;
+    size_t sqMapLen_, cqMapLen_, sqesLen_;
+
+    unsigned* sqHead_;
+    unsigned* sqTailShared_;
+    unsigned* sqArray_;
+    unsigned sqMask_, sqEntries_;
+    unsigned sqTail_;           // 本地的尾指针，submitAndWait时发布给内核
+    unsigned sqSubmitted_;      // 已被内核接受的SQE
+
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe* cqes_;
+};
+
+// 填写读写操作。bufIndex >= 0时使用注册过的固定缓冲区
+inline void uringPrepRw(io_uring_sqe* sqe, bool write, int fd, void* buf, unsigned len, uint64_t offset,
+    int bufIndex, uint64_t userData) {
+    if (bufIndex >= 0) {
+        sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = (uint16_t)bufIndex;
+    }
+    else {
+        sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = userData;
+}
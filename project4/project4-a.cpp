@@ -5,204 +5,7 @@
 #include <chrono>
 #include <algorithm>
 
-// 循环左移
-#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
-
-// 布尔函数
-#define FF0(x, y, z) ((x) ^ (y) ^ (z))
-#define FF1(x, y, z) (((x) & (y)) | ((x) & (z)) | ((y) & (z)))
-#define GG0(x, y, z) ((x) ^ (y) ^ (z))
-#define GG1(x, y, z) (((x) & (y)) | ((~(x)) & (z)))
-
-// 置换函数
-#define P0(x) ((x) ^ ROTL((x), 9) ^ ROTL((x), 17))
-#define P1(x) ((x) ^ ROTL((x), 15) ^ ROTL((x), 23))
-
-class SM3Base {
-public:
-    SM3Base() { reset(); }
-
-    void reset() {
-        state[0] = 0x7380166F;
-        state[1] = 0x4914B2B9;
-        state[2] = 0x172442D7;
-        state[3] = 0xDA8A0600;
-        state[4] = 0xA96F30BC;
-        state[5] = 0x163138AA;
-        state[6] = 0xE38DEE4D;
-        state[7] = 0xB0FB0E4E;
-        count = 0;
-        buffer.clear();
-    }
-
-    void update(const uint8_t* data, size_t len) {
-        buffer.insert(buffer.end(), data, data + len);
-        count += len * 8;
-    }
-
-    void finalize() {
-        uint64_t bitCount = count;
-        buffer.push_back(0x80);
-
-        // 计算填充长度
-        size_t paddingSize = (56 - (buffer.size() % 64)) % 64;
-        if (paddingSize > 0) {
-            buffer.insert(buffer.end(), paddingSize, 0);
-        }
-
-        // 添加消息长度（64位，大端序）
-        for (int i = 7; i >= 0; --i) {
-            buffer.push_back(static_cast<uint8_t>(bitCount >> (i * 8)));
-        }
-
-        // 处理每个512位块
-        for (size_t i = 0; i < buffer.size(); i += 64) {
-            compress(&buffer[i]);
-        }
-    }
-
-    std::vector<uint8_t> digest() {
-        std::vector<uint8_t> result(32);
-        for (int i = 0; i < 8; ++i) {
-            result[i * 4 + 0] = static_cast<uint8_t>(state[i] >> 24);
-            result[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
-            result[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
-            result[i * 4 + 3] = static_cast<uint8_t>(state[i]);
-        }
-        return result;
-    }
-
-protected:
-    virtual void compress(const uint8_t* block) {
-        uint32_t W[68], W1[64];
-
-        // 消息扩展：将512位块转换为16个32位字
-        for (int i = 0; i < 16; ++i) {
-            W[i] = (block[i * 4 + 0] << 24) | (block[i * 4 + 1] << 16) |
-                (block[i * 4 + 2] << 8) | (block[i * 4 + 3]);
-        }
-
-        // 扩展生成68个字
-        for (int i = 16; i < 68; ++i) {
-            W[i] = P1(W[i - 16] ^ W[i - 9] ^ ROTL(W[i - 3], 15)) ^
-                ROTL(W[i - 13], 7) ^ W[i - 6];
-        }
-
-        // 生成64个W'字
-        for (int i = 0; i < 64; ++i) {
-            W1[i] = W[i] ^ W[i + 4];
-        }
-
-        uint32_t A = state[0], B = state[1], C = state[2], D = state[3];
-        uint32_t E = state[4], F = state[5], G = state[6], H = state[7];
-
-        // 64轮压缩函数
-        for (int j = 0; j < 64; ++j) {
-            // 计算SS1和SS2
-            uint32_t SS1 = ROTL((ROTL(A, 12) + E + ROTL(T(j), j)), 7);
-            uint32_t SS2 = SS1 ^ ROTL(A, 12);
-
-            // 根据轮次选择布尔函数
-            uint32_t TT1 = (j < 16) ?
-                (FF0(A, B, C) + D + SS2 + W1[j]) :
-                (FF1(A, B, C) + D + SS2 + W1[j]);
-
-            uint32_t TT2 = (j < 16) ?
-                (GG0(E, F, G) + H + SS1 + W[j]) :
-                (GG1(E, F, G) + H + SS1 + W[j]);
-
-            // 更新寄存器（标准顺序）
-            D = C;
-            C = ROTL(B, 9);
-            B = A;
-            A = TT1;
-            H = G;
-            G = ROTL(F, 19);
-            F = E;
-            E = P0(TT2);
-        }
-
-        // 更新状态
-        state[0] ^= A;
-        state[1] ^= B;
-        state[2] ^= C;
-        state[3] ^= D;
-        state[4] ^= E;
-        state[5] ^= F;
-        state[6] ^= G;
-        state[7] ^= H;
-    }
-
-    // 常量生成函数
-    uint32_t T(int j) const {
-        return (j < 16) ? 0x79CC4519 : 0x7A879D8A;
-    }
-
-    uint32_t state[8];     // 哈希状态
-    uint64_t count;        // 消息总比特数
-    std::vector<uint8_t> buffer; // 输入缓冲区
-};
-
-class SM3Opt : public SM3Base {
-protected:
-    void compress(const uint8_t* block) override {
-        uint32_t W[68];
-
-        // 消息扩展：大端序处理
-        for (int i = 0; i < 16; i++) {
-            W[i] = (block[i * 4 + 0] << 24) | (block[i * 4 + 1] << 16) |
-                (block[i * 4 + 2] << 8) | (block[i * 4 + 3]);
-        }
-
-        // 扩展生成68个字
-        for (int i = 16; i < 68; i++) {
-            W[i] = P1(W[i - 16] ^ W[i - 9] ^ ROTL(W[i - 3], 15)) ^
-                ROTL(W[i - 13], 7) ^ W[i - 6];
-        }
-
-        // 使用局部变量存储状态
-        uint32_t A = state[0], B = state[1], C = state[2], D = state[3];
-        uint32_t E = state[4], F = state[5], G = state[6], H = state[7];
-
-        // 压缩函数 - 4轮展开优化
-        for (int j = 0; j < 64; j++) {
-            // 计算SS1和SS2
-            uint32_t SS1 = ROTL((ROTL(A, 12) + E + ROTL(T(j), j)), 7);
-            uint32_t SS2 = SS1 ^ ROTL(A, 12);
-
-            // 根据轮次选择布尔函数
-            uint32_t TT1, TT2;
-            if (j < 16) {
-                TT1 = FF0(A, B, C) + D + SS2 + (W[j] ^ W[j + 4]);
-                TT2 = GG0(E, F, G) + H + SS1 + W[j];
-            }
-            else {
-                TT1 = FF1(A, B, C) + D + SS2 + (W[j] ^ W[j + 4]);
-                TT2 = GG1(E, F, G) + H + SS1 + W[j];
-            }
-
-            // 更新寄存器（保持标准顺序）
-            D = C;
-            C = ROTL(B, 9);
-            B = A;
-            A = TT1;
-            H = G;
-            G = ROTL(F, 19);
-            F = E;
-            E = P0(TT2);
-        }
-
-        // 更新状态
-        state[0] ^= A;
-        state[1] ^= B;
-        state[2] ^= C;
-        state[3] ^= D;
-        state[4] ^= E;
-        state[5] ^= F;
-        state[6] ^= G;
-        state[7] ^= H;
-    }
-};
+#include "sm3.h"
 
 // 性能测试函数
 void test_performance(const char* name, SM3Base& sm3, const std::vector<uint8_t>& data) {
@@ -253,6 +56,14 @@ int main() {
     // 创建实例
     SM3Base base;
     SM3Opt opt;
+    SM3Fast fast;
+
+    std::cout << "自动选择的SM3内核: " << sm3_kernel_name() << "\n";
+    std::cout << "SM3内核自检: ";
+    for (const KernelSelfTest& r : sm3SelfTestResults()) {
+        std::cout << r.name << (!r.supported ? "(不支持) " : r.passed ? "(通过) " : "(未通过, 已禁用) ");
+    }
+    std::cout << "\n\n";
 
     // 测试空字符串
     std::cout << "测试空字符串:\n";
@@ -293,8 +104,15 @@ int main() {
     std::cout << "优化版 SM3(\"abc\") = ";
     print_hex(opt_digest);
 
+    fast.reset();
+    fast.update(abc.data(), abc.size());
+    fast.finalize();
+    auto fast_digest = fast.digest();
+    std::cout << "分派版 SM3(\"abc\") = ";
+    print_hex(fast_digest);
+
     // 比较结果
-    if (base_digest == opt_digest) {
+    if (base_digest == opt_digest && base_digest == fast_digest) {
         std::cout << "结果匹配!\n";
     }
     else {
@@ -306,6 +124,51 @@ int main() {
     std::cout << "性能测试 (100KB数据, 1000次迭代):\n";
     test_performance("基础版", base, long_text);
     test_performance("优化版", opt, long_text);
+    test_performance("分派版", fast, long_text);
+
+    // 分派版与基础版在不同长度上逐一比较
+    bool allMatch = true;
+    for (size_t len = 0; len < 300; len++) {
+        base.reset();
+        base.update(long_text.data(), len);
+        base.finalize();
+        fast.reset();
+        fast.update(long_text.data(), len);
+        fast.finalize();
+        allMatch = allMatch && (base.digest() == fast.digest());
+    }
+    std::cout << "分派版 0~299字节: " << (allMatch ? "结果匹配!" : "结果不匹配!") << std::endl;
+
+    // 流式杂凑：分两段输入，与SM3Base一次输入的结果比较
+    bool ctxMatch = true;
+    for (size_t len = 0; len < 300; len++) {
+        base.reset();
+        base.update(long_text.data(), len);
+        base.finalize();
+        Sm3Ctx ctx;
+        ctx.update(long_text.data(), len / 3);
+        ctx.update(long_text.data() + len / 3, len - len / 3);
+        std::vector<uint8_t> digest(32);
+        ctx.finalize(digest.data());
+        ctxMatch = ctxMatch && (base.digest() == digest);
+    }
+    std::cout << "流式版 0~299字节: " << (ctxMatch ? "结果匹配!" : "结果不匹配!") << std::endl;
+
+    // HMAC-SM3：与OpenSSL (openssl mac -digest SM3 HMAC) 的结果比较
+    const uint8_t hmacKey[16] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0xFE, 0xDC, 0xBA, 0x98, 0x76, 0x54, 0x32, 0x10 };
+    const std::vector<uint8_t> hmacExpected = {
+        0x28, 0xD8, 0xA6, 0x1B, 0xE6, 0x7D, 0x8B, 0xF7, 0x65, 0x2C, 0x4E, 0xDA, 0x70, 0x92, 0xB6, 0x12,
+        0xF8, 0x8B, 0xE6, 0x21, 0x84, 0xF5, 0x50, 0x05, 0xC5, 0x7D, 0xDF, 0x07, 0x6E, 0x76, 0x41, 0x99
+    };
+    HmacSm3Key hmacCtx(hmacKey, sizeof(hmacKey));
+    HmacSm3 hmac;
+    std::vector<uint8_t> mac(32);
+    hmac.init(hmacCtx);
+    hmac.update(abc.data(), abc.size());
+    hmac.finalize(mac.data());
+    std::cout << "HMAC-SM3(\"abc\") = ";
+    print_hex(mac);
+    std::cout << (mac == hmacExpected ? "结果匹配!" : "结果不匹配!") << std::endl;
 
     return 0;
 }
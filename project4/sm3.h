@@ -0,0 +1,641 @@
+#pragma once
+// SM3杂凑算法：基础版 / 优化版 / SSSE3版压缩函数与运行时分派
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <immintrin.h>
+
+#include "../project1/cpu_features.h"
+
+// 循环左移，n取1 ~ 31
+inline uint32_t sm3Rotl(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+// 布尔函数
+inline uint32_t sm3FF0(uint32_t x, uint32_t y, uint32_t z) {
+    return x ^ y ^ z;
+}
+
+inline uint32_t sm3FF1(uint32_t x, uint32_t y, uint32_t z) {
+    return (x & y) | (x & z) | (y & z);
+}
+
+inline uint32_t sm3GG0(uint32_t x, uint32_t y, uint32_t z) {
+    return x ^ y ^ z;
+}
+
+inline uint32_t sm3GG1(uint32_t x, uint32_t y, uint32_t z) {
+    return (x & y) | (~x & z);
+}
+
+// 置换函数
+inline uint32_t sm3P0(uint32_t x) {
+    return x ^ sm3Rotl(x, 9) ^ sm3Rotl(x, 17);
+}
+
+inline uint32_t sm3P1(uint32_t x) {
+    return x ^ sm3Rotl(x, 15) ^ sm3Rotl(x, 23);
+}
+
+// 预计算的 Tj <<< (j mod 32)，省去每轮的常量选择和移位。
+// j = 0和j = 32时移位量为0，单独处理，避免32位数移32位
+struct Sm3TjTable {
+    uint32_t v[64];
+};
+
+constexpr Sm3TjTable makeSm3TjTable() {
+    Sm3TjTable t = {};
+    for (int j = 0; j < 64; j++) {
+        uint32_t T = (j < 16) ? 0x79CC4519u : 0x7A879D8Au;
+        int n = j % 32;
+        t.v[j] = (n == 0) ? T : ((T << n) | (T >> (32 - n)));
+    }
+    return t;
+}
+
+inline constexpr Sm3TjTable kSm3Tj = makeSm3TjTable();
+
+// 基础版压缩函数
+inline void sm3CompressBase(uint32_t state[8], const uint8_t* block) {
+    uint32_t W[68], W1[64];
+
+    // 消息扩展：将512位块转换为16个32位字
+    for (int i = 0; i < 16; ++i) {
+        W[i] = (block[i * 4 + 0] << 24) | (block[i * 4 + 1] << 16) |
+            (block[i * 4 + 2] << 8) | (block[i * 4 + 3]);
+    }
+
+    // 扩展生成68个字
+    for (int i = 16; i < 68; ++i) {
+        W[i] = sm3P1(W[i - 16] ^ W[i - 9] ^ sm3Rotl(W[i - 3], 15)) ^
+            sm3Rotl(W[i - 13], 7) ^ W[i - 6];
+    }
+
+    // 生成64个W'字
+    for (int i = 0; i < 64; ++i) {
+        W1[i] = W[i] ^ W[i + 4];
+    }
+
+    uint32_t A = state[0], B = state[1], C = state[2], D = state[3];
+    uint32_t E = state[4], F = state[5], G = state[6], H = state[7];
+
+    // 64轮压缩函数
+    for (int j = 0; j < 64; ++j) {
+        // 计算SS1和SS2
+        uint32_t SS1 = sm3Rotl((sm3Rotl(A, 12) + E + kSm3Tj.v[j]), 7);
+        uint32_t SS2 = SS1 ^ sm3Rotl(A, 12);
+
+        // 根据轮次选择布尔函数
+        uint32_t TT1 = (j < 16) ?
+            (sm3FF0(A, B, C) + D + SS2 + W1[j]) :
+            (sm3FF1(A, B, C) + D + SS2 + W1[j]);
+
+        uint32_t TT2 = (j < 16) ?
+            (sm3GG0(E, F, G) + H + SS1 + W[j]) :
+            (sm3GG1(E, F, G) + H + SS1 + W[j]);
+
+        // 更新寄存器（标准顺序）
+        D = C;
+        C = sm3Rotl(B, 9);
+        B = A;
+        A = TT1;
+        H = G;
+        G = sm3Rotl(F, 19);
+        F = E;
+        E = sm3P0(TT2);
+    }
+
+    // 更新状态
+    state[0] ^= A;
+    state[1] ^= B;
+    state[2] ^= C;
+    state[3] ^= D;
+    state[4] ^= E;
+    state[5] ^= F;
+    state[6] ^= G;
+    state[7] ^= H;
+}
+
+// 优化版压缩函数：W'在轮函数中即时计算
+inline void sm3CompressOpt(uint32_t state[8], const uint8_t* block) {
+    uint32_t W[68];
+
+    // 消息扩展：大端序处理
+    for (int i = 0; i < 16; i++) {
+        W[i] = (block[i * 4 + 0] << 24) | (block[i * 4 + 1] << 16) |
+            (block[i * 4 + 2] << 8) | (block[i * 4 + 3]);
+    }
+
+    // 扩展生成68个字
+    for (int i = 16; i < 68; i++) {
+        W[i] = sm3P1(W[i - 16] ^ W[i - 9] ^ sm3Rotl(W[i - 3], 15)) ^
+            sm3Rotl(W[i - 13], 7) ^ W[i - 6];
+    }
+
+    // 使用局部变量存储状态
+    uint32_t A = state[0], B = state[1], C = state[2], D = state[3];
+    uint32_t E = state[4], F = state[5], G = state[6], H = state[7];
+
+    // 压缩函数
+    for (int j = 0; j < 64; j++) {
+        // 计算SS1和SS2
+        uint32_t SS1 = sm3Rotl((sm3Rotl(A, 12) + E + kSm3Tj.v[j]), 7);
+        uint32_t SS2 = SS1 ^ sm3Rotl(A, 12);
+
+        // 根据轮次选择布尔函数
+        uint32_t TT1, TT2;
+        if (j < 16) {
+            TT1 = sm3FF0(A, B, C) + D + SS2 + (W[j] ^ W[j + 4]);
+            TT2 = sm3GG0(E, F, G) + H + SS1 + W[j];
+        }
+        else {
+            TT1 = sm3FF1(A, B, C) + D + SS2 + (W[j] ^ W[j + 4]);
+            TT2 = sm3GG1(E, F, G) + H + SS1 + W[j];
+        }
+
+        // 更新寄存器（保持标准顺序）
+        D = C;
+        C = sm3Rotl(B, 9);
+        B = A;
+        A = TT1;
+        H = G;
+        G = sm3Rotl(F, 19);
+        F = E;
+        E = sm3P0(TT2);
+    }
+
+    // 更新状态
+    state[0] ^= A;
+    state[1] ^= B;
+    state[2] ^= C;
+    state[3] ^= D;
+    state[4] ^= E;
+    state[5] ^= F;
+    state[6] ^= G;
+    state[7] ^= H;
+}
+
+// -------------------------- SSSE3优化版本 --------------------------
+
+CPU_TARGET("ssse3")
+inline __m128i rotlSSSE3(__m128i x, int n) {
+    return _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n));
+}
+
+CPU_TARGET("ssse3")
+inline __m128i p1SSSE3(__m128i x) {
+    return _mm_xor_si128(x, _mm_xor_si128(rotlSSSE3(x, 15), rotlSSSE3(x, 23)));
+}
+
+// SSSE3版压缩函数：消息扩展每次算4个字，W'整体向量化计算
+CPU_TARGET("ssse3")
+inline void sm3CompressSSSE3(uint32_t state[8], const uint8_t* block) {
+    alignas(16) uint32_t W[68];
+    alignas(16) uint32_t W1[64];
+    const __m128i bswap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+    for (int i = 0; i < 16; i += 4) {
+        _mm_store_si128((__m128i*)(W + i),
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(block + 4 * i)), bswap));
+    }
+
+    // W[i+3]依赖本组的W[i]：先把该项当作0算出4个字，
+    // 再利用P1的线性补上 P1(W[i] <<< 15) 这一项
+    for (int i = 16; i < 68; i += 4) {
+        __m128i w3 = _mm_srli_si128(_mm_loadu_si128((const __m128i*)(W + i - 4)), 4);
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(W + i - 16)),
+            _mm_loadu_si128((const __m128i*)(W + i - 9)));
+        x = p1SSSE3(_mm_xor_si128(x, rotlSSSE3(w3, 15)));
+        x = _mm_xor_si128(x, rotlSSSE3(_mm_loadu_si128((const __m128i*)(W + i - 13)), 7));
+        x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i*)(W + i - 6)));
+        __m128i fix = p1SSSE3(rotlSSSE3(_mm_shuffle_epi32(x, 0x00), 15));
+        x = _mm_xor_si128(x, _mm_slli_si128(fix, 12));
+        _mm_store_si128((__m128i*)(W + i), x);
+    }
+
+    for (int i = 0; i < 64; i += 4) {
+        _mm_store_si128((__m128i*)(W1 + i), _mm_xor_si128(_mm_load_si128((const __m128i*)(W + i)),
+            _mm_load_si128((const __m128i*)(W + i + 4))));
+    }
+
+    uint32_t A = state[0], B = state[1], C = state[2], D = state[3];
+    uint32_t E = state[4], F = state[5], G = state[6], H = state[7];
+
+    // 前16轮与后48轮分开，循环内不再判断轮次
+    for (int j = 0; j < 16; j++) {
+        uint32_t A12 = sm3Rotl(A, 12);
+        uint32_t SS1 = sm3Rotl(A12 + E + kSm3Tj.v[j], 7);
+        uint32_t SS2 = SS1 ^ A12;
+        uint32_t TT1 = sm3FF0(A, B, C) + D + SS2 + W1[j];
+        uint32_t TT2 = sm3GG0(E, F, G) + H + SS1 + W[j];
+        D = C;
+        C = sm3Rotl(B, 9);
+        B = A;
+        A = TT1;
+        H = G;
+        G = sm3Rotl(F, 19);
+        F = E;
+        E = sm3P0(TT2);
+    }
+    for (int j = 16; j < 64; j++) {
+        uint32_t A12 = sm3Rotl(A, 12);
+        uint32_t SS1 = sm3Rotl(A12 + E + kSm3Tj.v[j], 7);
+        uint32_t SS2 = SS1 ^ A12;
+        uint32_t TT1 = sm3FF1(A, B, C) + D + SS2 + W1[j];
+        uint32_t TT2 = sm3GG1(E, F, G) + H + SS1 + W[j];
+        D = C;
+        C = sm3Rotl(B, 9);
+        B = A;
+        A = TT1;
+        H = G;
+        G = sm3Rotl(F, 19);
+        F = E;
+        E = sm3P0(TT2);
+    }
+
+    state[0] ^= A;
+    state[1] ^= B;
+    state[2] ^= C;
+    state[3] ^= D;
+    state[4] ^= E;
+    state[5] ^= F;
+    state[6] ^= G;
+    state[7] ^= H;
+}
+
+// -------------------------- 运行时内核分派 --------------------------
+
+typedef void (*Sm3CompressFunc)(uint32_t state[8], const uint8_t* block);
+
+struct Sm3Kernel {
+    const char* name;               // 内核名，可通过环境变量SM3_KERNEL指定
+    uint32_t required;              // 所需CPU特性 (CpuFeature位掩码)
+    Sm3CompressFunc compress;
+};
+
+// 按优先级从高到低排列
+inline constexpr Sm3Kernel kSm3Kernels[] = {
+    { "ssse3", CPU_SSSE3, sm3CompressSSSE3 },
+    { "opt", 0, sm3CompressOpt },
+    { "base", 0, sm3CompressBase },
+};
+
+// -------------------------- 内核自检 --------------------------
+
+// GB/T 32905附录A的两个示例："abc"和64字节的"abcd"重复16次
+const uint8_t kSm3TestDigestAbc[32] = {
+    0x66, 0xC7, 0xF0, 0xF4, 0x62, 0xEE, 0xED, 0xD9, 0xD1, 0xF2, 0xD4, 0x6B, 0xDC, 0x10, 0xE4, 0xE2,
+    0x41, 0x67, 0xC4, 0x87, 0x5C, 0xF2, 0xF7, 0xA2, 0x29, 0x7D, 0xA0, 0x2B, 0x8F, 0x4B, 0xA8, 0xE0
+};
+const uint8_t kSm3TestDigestAbcd16[32] = {
+    0xDE, 0xBE, 0x9F, 0xF9, 0x22, 0x75, 0xB8, 0xA1, 0x38, 0x60, 0x48, 0x89, 0xC1, 0x8E, 0x5A, 0x4D,
+    0x6F, 0xDB, 0x70, 0xE5, 0x38, 0x7E, 0x57, 0x65, 0x29, 0x3D, 0xCB, 0xA3, 0x9C, 0x0C, 0x57, 0x32
+};
+
+// 自检中随机分组的个数 (连续压缩，状态一路传递)
+const size_t kSm3SelfTestBlocks = 128;
+
+const uint32_t kSm3IV[8] = {
+    0x7380166F, 0x4914B2B9, 0x172442D7, 0xDA8A0600, 0xA96F30BC, 0x163138AA, 0xE38DEE4D, 0xB0FB0E4E
+};
+
+// 不超过64字节的消息：填充后用f压缩，与标准杂凑值比较
+inline bool sm3SelfTestVector(Sm3CompressFunc f, const uint8_t* msg, size_t len, const uint8_t expected[32]) {
+    uint8_t buf[128] = { 0 };
+    memcpy(buf, msg, len);
+    buf[len] = 0x80;
+    size_t total = (len + 9 <= 64) ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++) {
+        buf[total - 1 - i] = (uint8_t)(bits >> (8 * i));
+    }
+
+    uint32_t state[8];
+    memcpy(state, kSm3IV, sizeof(state));
+    for (size_t off = 0; off < total; off += 64) {
+        f(state, buf + off);
+    }
+    for (int i = 0; i < 8; i++) {
+        uint8_t w[4] = { (uint8_t)(state[i] >> 24), (uint8_t)(state[i] >> 16), (uint8_t)(state[i] >> 8), (uint8_t)state[i] };
+        if (memcmp(w, expected + 4 * i, 4) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline std::vector<KernelSelfTest> sm3RunSelfTest() {
+    const uint8_t abc[3] = { 'a', 'b', 'c' };
+    uint8_t abcd16[64];
+    for (int i = 0; i < 64; i++) {
+        abcd16[i] = (uint8_t)('a' + i % 4);
+    }
+
+    // 随机分组的参考结果：每压缩一个分组记录一次状态
+    uint64_t seed = 0x534D332D54455354ull;
+    std::vector<uint8_t> blocks(64 * kSm3SelfTestBlocks);
+    selfTestFill(blocks.data(), blocks.size(), seed);
+    std::vector<uint32_t> ref(8 * kSm3SelfTestBlocks);
+    uint32_t state[8];
+    memcpy(state, kSm3IV, sizeof(state));
+    for (size_t i = 0; i < kSm3SelfTestBlocks; i++) {
+        sm3CompressBase(state, blocks.data() + 64 * i);
+        memcpy(&ref[8 * i], state, sizeof(state));
+    }
+
+    std::vector<KernelSelfTest> results;
+    for (const Sm3Kernel& k : kSm3Kernels) {
+        bool supported = cpuHas(k.required);
+        bool passed = supported && sm3SelfTestVector(k.compress, abc, sizeof(abc), kSm3TestDigestAbc)
+            && sm3SelfTestVector(k.compress, abcd16, sizeof(abcd16), kSm3TestDigestAbcd16);
+        memcpy(state, kSm3IV, sizeof(state));
+        for (size_t i = 0; passed && i < kSm3SelfTestBlocks; i++) {
+            k.compress(state, blocks.data() + 64 * i);
+            passed = memcmp(state, &ref[8 * i], sizeof(state)) == 0;
+        }
+        results.push_back({ k.name, supported, passed });
+    }
+    return results;
+}
+
+// 自检结果，顺序与kSm3Kernels相同。首次调用时执行 (即进程启动选择内核时)
+inline const std::vector<KernelSelfTest>& sm3SelfTestResults() {
+    static const std::vector<KernelSelfTest> results = sm3RunSelfTest();
+    return results;
+}
+
+// CPU支持且通过自检的内核才参与分派
+inline bool sm3KernelUsable(const Sm3Kernel& k) {
+    return sm3SelfTestResults()[&k - kSm3Kernels].passed;
+}
+
+inline const Sm3Kernel* sm3SelectKernel() {
+    const char* forced = getenv("SM3_KERNEL");
+    if (forced != nullptr && forced[0] != '\0') {
+        for (const Sm3Kernel& k : kSm3Kernels) {
+            if (strcmp(k.name, forced) == 0 && sm3KernelUsable(k)) {
+                return &k;
+            }
+        }
+        fprintf(stderr, "SM3_KERNEL=%s 不存在、当前CPU不支持或未通过自检，改为自动选择\n", forced);
+    }
+
+    for (const Sm3Kernel& k : kSm3Kernels) {
+        if (sm3KernelUsable(k)) {
+            return &k;
+        }
+    }
+    return &kSm3Kernels[2];
+}
+
+inline const Sm3Kernel* const g_sm3Kernel = sm3SelectKernel();
+
+// 当前使用的内核名
+inline const char* sm3_kernel_name() {
+    return g_sm3Kernel->name;
+}
+
+// -------------------------- 杂凑接口 --------------------------
+
+class SM3Base {
+public:
+    SM3Base() { reset(); }
+    virtual ~SM3Base() {}
+
+    void reset() {
+        state[0] = 0x7380166F;
+        state[1] = 0x4914B2B9;
+        state[2] = 0x172442D7;
+        state[3] = 0xDA8A0600;
+        state[4] = 0xA96F30BC;
+        state[5] = 0x163138AA;
+        state[6] = 0xE38DEE4D;
+        state[7] = 0xB0FB0E4E;
+        count = 0;
+        buffer.clear();
+    }
+
+    void update(const uint8_t* data, size_t len) {
+        buffer.insert(buffer.end(), data, data + len);
+        count += len * 8;
+    }
+
+    void finalize() {
+        uint64_t bitCount = count;
+        buffer.push_back(0x80);
+
+        // 计算填充长度
+        size_t paddingSize = (56 - (buffer.size() % 64)) % 64;
+        if (paddingSize > 0) {
+            buffer.insert(buffer.end(), paddingSize, 0);
+        }
+
+        // 添加消息长度（64位，大端序）
+        for (int i = 7; i >= 0; --i) {
+            buffer.push_back(static_cast<uint8_t>(bitCount >> (i * 8)));
+        }
+
+        // 处理每个512位块
+        for (size_t i = 0; i < buffer.size(); i += 64) {
+            compress(&buffer[i]);
+        }
+    }
+
+    std::vector<uint8_t> digest() {
+        std::vector<uint8_t> result(32);
+        for (int i = 0; i < 8; ++i) {
+            result[i * 4 + 0] = static_cast<uint8_t>(state[i] >> 24);
+            result[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
+            result[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
+            result[i * 4 + 3] = static_cast<uint8_t>(state[i]);
+        }
+        return result;
+    }
+
+protected:
+    virtual void compress(const uint8_t* block) {
+        sm3CompressBase(state, block);
+    }
+
+    uint32_t state[8];     // 哈希状态
+    uint64_t count;        // 消息总比特数
+    std::vector<uint8_t> buffer; // 输入缓冲区
+};
+
+class SM3Opt : public SM3Base {
+protected:
+    void compress(const uint8_t* block) override {
+        sm3CompressOpt(state, block);
+    }
+};
+
+// 使用运行时分派选定的压缩函数
+class SM3Fast : public SM3Base {
+protected:
+    void compress(const uint8_t* block) override {
+        g_sm3Kernel->compress(state, block);
+    }
+};
+
+// -------------------------- 流式杂凑与HMAC --------------------------
+
+// 清除密钥材料和中间状态 (volatile写入，避免被优化掉)
+inline void sm3Wipe(void* p, size_t n) {
+    volatile uint8_t* v = static_cast<volatile uint8_t*>(p);
+    for (size_t i = 0; i < n; i++) {
+        v[i] = 0;
+    }
+}
+
+// SM3Base把整条消息缓存到finalize才压缩；Sm3Ctx只保留不足一个分组的尾部，
+// 完整分组在update中直接交给分派选定的压缩函数，内存占用固定
+class Sm3Ctx {
+public:
+    Sm3Ctx() { init(); }
+
+    ~Sm3Ctx() {
+        wipe();
+    }
+
+    void init() {
+        memcpy(state_, kSm3IV, sizeof(state_));
+        bufLen_ = 0;
+        count_ = 0;
+    }
+
+    void update(const uint8_t* data, size_t len) {
+        count_ += len;
+        if (bufLen_ > 0) {
+            size_t n = std::min(len, 64 - bufLen_);
+            memcpy(buf_ + bufLen_, data, n);
+            bufLen_ += n;
+            data += n;
+            len -= n;
+            if (bufLen_ < 64) {
+                return;
+            }
+            g_sm3Kernel->compress(state_, buf_);
+            bufLen_ = 0;
+        }
+        for (; len >= 64; data += 64, len -= 64) {
+            g_sm3Kernel->compress(state_, data);
+        }
+        memcpy(buf_, data, len);
+        bufLen_ = len;
+    }
+
+    // 输出32字节杂凑值；之后须重新init
+    void finalize(uint8_t digest[32]) {
+        uint64_t bits = count_ * 8;
+        buf_[bufLen_++] = 0x80;
+        if (bufLen_ > 56) {
+            memset(buf_ + bufLen_, 0, 64 - bufLen_);
+            g_sm3Kernel->compress(state_, buf_);
+            bufLen_ = 0;
+        }
+        memset(buf_ + bufLen_, 0, 56 - bufLen_);
+        for (int i = 0; i < 8; i++) {
+            buf_[63 - i] = (uint8_t)(bits >> (8 * i));
+        }
+        g_sm3Kernel->compress(state_, buf_);
+        for (int i = 0; i < 8; i++) {
+            digest[4 * i + 0] = (uint8_t)(state_[i] >> 24);
+            digest[4 * i + 1] = (uint8_t)(state_[i] >> 16);
+            digest[4 * i + 2] = (uint8_t)(state_[i] >> 8);
+            digest[4 * i + 3] = (uint8_t)state_[i];
+        }
+        wipe();
+    }
+
+private:
+    friend class HmacSm3;
+
+    void wipe() {
+        sm3Wipe(state_, sizeof(state_));
+        sm3Wipe(buf_, sizeof(buf_));
+    }
+
+    uint32_t state_[8];
+    uint8_t buf_[64];
+    size_t bufLen_;
+    uint64_t count_;        // 消息总字节数
+};
+
+// HMAC-SM3 (GB/T 15852.2 / RFC 2104)：HMAC(K, m) = H((K0 ^ opad) || H((K0 ^ ipad) || m))。
+// 密钥上下文预先压缩K0 ^ ipad与K0 ^ opad两个分组，每条消息只需复制状态
+struct HmacSm3Key {
+    Sm3Ctx inner;
+    Sm3Ctx outer;
+
+    HmacSm3Key() {
+    }
+
+    HmacSm3Key(const uint8_t* key, size_t keyLen) {
+        set(key, keyLen);
+    }
+
+    // 长于一个分组的密钥先做一次杂凑
+    void set(const uint8_t* key, size_t keyLen) {
+        uint8_t k0[64] = { 0 };
+        if (keyLen > 64) {
+            Sm3Ctx h;
+            h.update(key, keyLen);
+            h.finalize(k0);
+        }
+        else {
+            memcpy(k0, key, keyLen);
+        }
+        uint8_t pad[64];
+        for (int i = 0; i < 64; i++) {
+            pad[i] = k0[i] ^ 0x36;
+        }
+        inner.init();
+        inner.update(pad, 64);
+        for (int i = 0; i < 64; i++) {
+            pad[i] = k0[i] ^ 0x5C;
+        }
+        outer.init();
+        outer.update(pad, 64);
+        sm3Wipe(k0, sizeof(k0));
+        sm3Wipe(pad, sizeof(pad));
+    }
+};
+
+class HmacSm3 {
+public:
+    HmacSm3() : key_(nullptr) {
+    }
+
+    void init(const HmacSm3Key& key) {
+        key_ = &key;
+        memcpy(ctx_.state_, key.inner.state_, sizeof(ctx_.state_));
+        ctx_.bufLen_ = 0;
+        ctx_.count_ = 64;
+    }
+
+    void update(const uint8_t* data, size_t len) {
+        ctx_.update(data, len);
+    }
+
+    // 输出32字节MAC；之后须重新init
+    void finalize(uint8_t mac[32]) {
+        uint8_t h[32];
+        ctx_.finalize(h);
+        memcpy(ctx_.state_, key_->outer.state_, sizeof(ctx_.state_));
+        ctx_.bufLen_ = 0;
+        ctx_.count_ = 64;
+        ctx_.update(h, 32);
+        ctx_.finalize(mac);
+        sm3Wipe(h, sizeof(h));
+    }
+
+private:
+    const HmacSm3Key* key_;
+    Sm3Ctx ctx_;
+};